@@ -11,7 +11,63 @@
 #include <array>
 #include <cassert>
 #include <type_traits>
-#include <random> 
+#include <cstdint>
+#include <string>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <cstdio>
+#include <cstdlib>
+#include <cmath>
+#include <future>
+#include <unordered_map>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <cstring>
+#include <deque>
+#include <tuple>
+#include <iterator>
+#include <limits>
+#include <initializer_list>
+
+// Live statistics are exported through a shared memory segment.
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#include <intrin.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+// Batch math uses the widest vector instructions the target has. 
+// Defining `SPACE_INVADERS_NO_SIMD` forces the plain scalar version.
+#ifndef SPACE_INVADERS_NO_SIMD
+#if defined(__AVX__)
+#include <immintrin.h>
+#define SPACE_INVADERS_SIMD_AVX
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define SPACE_INVADERS_SIMD_SSE2
+#endif
+#endif
+
+// Debug builds check that systems only touch the components they 
+// declared (see `AccessValidator`). Release builds compile it out, and 
+// defining `SPACE_INVADERS_NO_ACCESS_VALIDATION` turns it off in debug.
+#if !defined(NDEBUG) && !defined(SPACE_INVADERS_NO_ACCESS_VALIDATION)
+#define SPACE_INVADERS_VALIDATE_ACCESS
+#include <typeinfo>
+#ifndef _WIN32
+#include <execinfo.h>
+#include <cstdlib>
+#endif
+#endif
 
 // We will need some additional includes for frametime handling
 // and callbacks.
@@ -24,8 +80,450 @@
 
 namespace SpaceInvaders
 {
-	// C++11 pseudo-random generator
-	std::minstd_rand rndEngine;
+	// Counter-based pseudo-random generator.
+	// Instead of a single global engine whose output depends on the order
+	// in which entities happen to pull from it, every value is a pure
+	// function of a 64-bit key and an index: `value = Mix(key, index)`.
+	// Different worlds and systems get different keys, so their streams
+	// never interfere, and any element of a stream can be computed
+	// independently (which is what parallel and bulk consumers need).
+	namespace Internal
+	{
+		// SplitMix64 finalizer: a cheap, well-distributed 64-bit mixer.
+		inline std::uint64_t MixBits(std::uint64_t x) noexcept
+		{
+			x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ull;
+			x = (x ^ (x >> 27)) * 0x94D049BB133111EBull;
+			return x ^ (x >> 31);
+		}
+
+		inline std::uint64_t RandomAt(std::uint64_t key, std::uint64_t index) noexcept
+		{
+			return MixBits(key ^ MixBits(index + 0x9E3779B97F4A7C15ull));
+		}
+
+		// Maps the upper 32 bits of `bits` onto [0, range) with a multiply
+		// and a shift. Unlike `bits % range` the bias is bounded by
+		// range / 2^32, which is negligible for the ranges we use.
+		inline std::uint32_t ReduceToRange(std::uint64_t bits, std::uint32_t range) noexcept
+		{
+			return static_cast<std::uint32_t>(((bits >> 32) * range) >> 32);
+		}
+	}
+
+	// A stream is just a key plus a cursor. It is small enough to be
+	// stored by value inside a component.
+	struct RandomStream
+	{
+		std::uint64_t key{0};
+		std::uint64_t counter{0};
+
+		RandomStream() = default;
+		RandomStream(std::uint64_t key) : key{ key } { }
+
+		std::uint64_t Next() noexcept
+		{
+			return Internal::RandomAt(key, counter++);
+		}
+
+		// Returns a float in the half-open range [min, max).
+		float NextFloat(float min, float max) noexcept
+		{
+			auto unit(static_cast<float>(Next() >> 40) * (1.f / 16777216.f));
+			return min + (max - min) * unit;
+		}
+
+		// Returns an integer in the closed range [min, max].
+		int NextInt(int min, int max) noexcept
+		{
+			auto range(static_cast<std::uint32_t>(max - min) + 1u);
+			return min + static_cast<int>(Internal::ReduceToRange(Next(), range));
+		}
+
+		// Bulk version of `NextInt`: element `i` of `out` only depends on
+		// the key and on `counter + i`, so the loop has no carried state
+		// and the compiler is free to vectorize it. It gives the same 
+		// numbers as `count` calls to `NextInt`.
+		void FillInt(int* out, std::size_t count, int min, int max) noexcept
+		{
+			auto range(static_cast<std::uint32_t>(max - min) + 1u);
+			auto first(counter);
+
+			for (std::size_t i{0}; i < count; ++i)
+			{
+				auto bits(Internal::RandomAt(key, first + i));
+				out[i] = min + static_cast<int>(Internal::ReduceToRange(bits, range));
+			}
+
+			counter += count;
+		}
+	};
+
+	// Systems that need randomness ask for their own stream id.
+	enum class RandomStreamID : std::uint32_t
+	{
+		WeaponAI,
+		WorldGeneration,
+		Particles
+	};
+
+	// Every world owns a `RandomService` created from a single seed.
+	// A stream is identified by the system using it and an optional
+	// `instance` (for example the slot of an enemy in its formation),
+	// which keeps results reproducible regardless of update order.
+	class RandomService
+	{
+		private:
+			std::uint64_t seed;
+
+		public:
+			RandomService(std::uint64_t seed) : seed{ seed } { }
+
+			RandomStream GetStream(RandomStreamID id, std::uint64_t instance = 0) const noexcept
+			{
+				auto streamKey(Internal::MixBits(seed ^ Internal::MixBits(
+					(static_cast<std::uint64_t>(id) << 32) ^ instance)));
+				return RandomStream{ streamKey };
+			}
+	};
+
+	// Q16.16 fixed point number: 16 bits of integer part and 16 bits of 
+	// fraction, stored in an `int32_t`. Integer arithmetic gives the same
+	// results with every compiler, set of flags and instruction set, which
+	// floats don't guarantee. That's what lockstep and replays need.
+	// Conversions from and to floats are explicit, so that they only 
+	// happen at the boundaries (constants, rendering).
+	class Fixed
+	{
+		private:
+			std::int32_t raw{0};
+
+			// Visual Studio 2015 has no C++14 constexpr: `FromRaw` has to
+			// be a single return statement, hence this constructor.
+			struct RawTag { };
+			constexpr Fixed(RawTag, std::int32_t value) noexcept : raw(value) { }
+
+		public:
+			static constexpr int fractionBits{16};
+			static constexpr std::int32_t one{1 << fractionBits};
+
+			static constexpr Fixed FromRaw(std::int32_t value) noexcept
+			{
+				return Fixed{ RawTag{}, value };
+			}
+
+			constexpr Fixed() = default;
+			explicit constexpr Fixed(int value) noexcept : raw(value * one) { }
+
+			// Scaling by a power of two is exact, so this conversion is as
+			// deterministic as the float it starts from.
+			explicit Fixed(float value) noexcept 
+				: raw(static_cast<std::int32_t>(std::lround(value * static_cast<float>(one)))) { }
+
+			explicit operator float() const noexcept 
+			{ 
+				return static_cast<float>(raw) * (1.f / static_cast<float>(one)); 
+			}
+
+			constexpr std::int32_t GetRaw() const noexcept { return raw; }
+
+			// Products and quotients go through 64 bits. Right shifts of
+			// negative values are arithmetic on every compiler we use.
+			friend constexpr Fixed operator+(Fixed a, Fixed b) noexcept { return FromRaw(a.raw + b.raw); }
+			friend constexpr Fixed operator-(Fixed a, Fixed b) noexcept { return FromRaw(a.raw - b.raw); }
+			friend constexpr Fixed operator-(Fixed a) noexcept { return FromRaw(-a.raw); }
+
+			friend constexpr Fixed operator*(Fixed a, Fixed b) noexcept
+			{
+				return FromRaw(static_cast<std::int32_t>(
+					(static_cast<std::int64_t>(a.raw) * b.raw) >> fractionBits));
+			}
+
+			friend constexpr Fixed operator/(Fixed a, Fixed b) noexcept
+			{
+				return FromRaw(static_cast<std::int32_t>(
+					(static_cast<std::int64_t>(a.raw) * one) / b.raw));
+			}
+
+			Fixed& operator+=(Fixed other) noexcept { raw += other.raw; return *this; }
+			Fixed& operator-=(Fixed other) noexcept { raw -= other.raw; return *this; }
+			Fixed& operator*=(Fixed other) noexcept { return *this = *this * other; }
+			Fixed& operator/=(Fixed other) noexcept { return *this = *this / other; }
+
+			friend constexpr bool operator==(Fixed a, Fixed b) noexcept { return a.raw == b.raw; }
+			friend constexpr bool operator!=(Fixed a, Fixed b) noexcept { return a.raw != b.raw; }
+			friend constexpr bool operator<(Fixed a, Fixed b) noexcept { return a.raw < b.raw; }
+			friend constexpr bool operator>(Fixed a, Fixed b) noexcept { return a.raw > b.raw; }
+			friend constexpr bool operator<=(Fixed a, Fixed b) noexcept { return a.raw <= b.raw; }
+			friend constexpr bool operator>=(Fixed a, Fixed b) noexcept { return a.raw >= b.raw; }
+	};
+
+	// The simulation (`Transform`, `Physics` and collisions) uses `Scalar` 
+	// and `Vec2`. Defining `SPACE_INVADERS_FIXED_POINT` switches them from
+	// floats to `Fixed`. Rendering, particles and the HUD always use floats:
+	// they don't affect the simulation. Use `Scalar(x)` to convert a value 
+	// to the simulation type and `ToFloat`/`sf::Vector2f(v)` to get back.
+#ifdef SPACE_INVADERS_FIXED_POINT
+	using Scalar = Fixed;
+#else
+	using Scalar = float;
+#endif
+	using Vec2 = sf::Vector2<Scalar>;
+
+	inline float ToFloat(Scalar value) noexcept { return static_cast<float>(value); }
+
+	// Systems that run the same math over a lot of entities or particles
+	// can process them eight at a time, reading and writing structure of
+	// arrays data. Every instruction set provides the same few operations
+	// on a `Register` of `lanes` floats; masks are registers too, with
+	// every bit of a lane set when it's true. `Min` and `Max` pick the 
+	// same operand as `std::min` and `std::max` when the values compare 
+	// equal (`0.f` and `-0.f`), so that batched and scalar code agree bit 
+	// for bit. Other targets, ARM included, use the plain C++ version.
+	namespace Internal
+	{
+		namespace Simd
+		{
+#if defined(SPACE_INVADERS_SIMD_AVX)
+			using Register = __m256;
+			const std::size_t lanes{8};
+			const char* const name{"AVX"};
+
+			inline Register Load(const float* p) noexcept { return _mm256_loadu_ps(p); }
+			inline void Store(float* p, Register a) noexcept { _mm256_storeu_ps(p, a); }
+			inline Register Broadcast(float value) noexcept { return _mm256_set1_ps(value); }
+			inline Register Add(Register a, Register b) noexcept { return _mm256_add_ps(a, b); }
+			inline Register Sub(Register a, Register b) noexcept { return _mm256_sub_ps(a, b); }
+			inline Register Mul(Register a, Register b) noexcept { return _mm256_mul_ps(a, b); }
+			inline Register Min(Register a, Register b) noexcept { return _mm256_min_ps(b, a); }
+			inline Register Max(Register a, Register b) noexcept { return _mm256_max_ps(b, a); }
+			inline Register Less(Register a, Register b) noexcept { return _mm256_cmp_ps(a, b, _CMP_LT_OQ); }
+			inline Register LessEqual(Register a, Register b) noexcept { return _mm256_cmp_ps(a, b, _CMP_LE_OQ); }
+			inline Register And(Register a, Register b) noexcept { return _mm256_and_ps(a, b); }
+			inline Register Or(Register a, Register b) noexcept { return _mm256_or_ps(a, b); }
+			inline Register Select(Register mask, Register a, Register b) noexcept { return _mm256_blendv_ps(b, a, mask); }
+			inline unsigned MoveMask(Register mask) noexcept { return static_cast<unsigned>(_mm256_movemask_ps(mask)); }
+			inline void StoreMasked(float* p, Register mask, Register a) noexcept 
+			{ 
+				_mm256_maskstore_ps(p, _mm256_castps_si256(mask), a); 
+			}
+#elif defined(SPACE_INVADERS_SIMD_SSE2)
+			using Register = __m128;
+			const std::size_t lanes{4};
+			const char* const name{"SSE2"};
+
+			inline Register Load(const float* p) noexcept { return _mm_loadu_ps(p); }
+			inline void Store(float* p, Register a) noexcept { _mm_storeu_ps(p, a); }
+			inline Register Broadcast(float value) noexcept { return _mm_set1_ps(value); }
+			inline Register Add(Register a, Register b) noexcept { return _mm_add_ps(a, b); }
+			inline Register Sub(Register a, Register b) noexcept { return _mm_sub_ps(a, b); }
+			inline Register Mul(Register a, Register b) noexcept { return _mm_mul_ps(a, b); }
+			inline Register Min(Register a, Register b) noexcept { return _mm_min_ps(b, a); }
+			inline Register Max(Register a, Register b) noexcept { return _mm_max_ps(b, a); }
+			inline Register Less(Register a, Register b) noexcept { return _mm_cmplt_ps(a, b); }
+			inline Register LessEqual(Register a, Register b) noexcept { return _mm_cmple_ps(a, b); }
+			inline Register And(Register a, Register b) noexcept { return _mm_and_ps(a, b); }
+			inline Register Or(Register a, Register b) noexcept { return _mm_or_ps(a, b); }
+			inline Register Select(Register mask, Register a, Register b) noexcept 
+			{ 
+				return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b)); 
+			}
+			inline unsigned MoveMask(Register mask) noexcept { return static_cast<unsigned>(_mm_movemask_ps(mask)); }
+
+			// SSE2 has no masked store of floats, and loading, blending and 
+			// storing back would write the other lanes too, racing with 
+			// whoever owns them. One lane at a time it is.
+			inline void StoreMasked(float* p, Register mask, Register a) noexcept 
+			{ 
+				float values[lanes];
+				_mm_storeu_ps(values, a);
+
+				auto bits(MoveMask(mask));
+				for (std::size_t i{0}; i < lanes; ++i)
+					if (bits & (1u << i)) p[i] = values[i];
+			}
+#else
+			// Plain C++: a register is a single float, and the compiler is 
+			// free to vectorize the loops on its own.
+			using Register = float;
+			const std::size_t lanes{1};
+			const char* const name{"scalar"};
+
+			inline std::uint32_t ToBits(float value) noexcept 
+			{ 
+				std::uint32_t bits; 
+				std::memcpy(&bits, &value, sizeof(bits)); 
+				return bits; 
+			}
+
+			inline float FromBits(std::uint32_t bits) noexcept 
+			{ 
+				float value; 
+				std::memcpy(&value, &bits, sizeof(value)); 
+				return value; 
+			}
+
+			inline Register Load(const float* p) noexcept { return *p; }
+			inline void Store(float* p, Register a) noexcept { *p = a; }
+			inline Register Broadcast(float value) noexcept { return value; }
+			inline Register Add(Register a, Register b) noexcept { return a + b; }
+			inline Register Sub(Register a, Register b) noexcept { return a - b; }
+			inline Register Mul(Register a, Register b) noexcept { return a * b; }
+			inline Register Min(Register a, Register b) noexcept { return b < a ? b : a; }
+			inline Register Max(Register a, Register b) noexcept { return b > a ? b : a; }
+			inline Register Less(Register a, Register b) noexcept { return FromBits(a < b ? 0xFFFFFFFFu : 0u); }
+			inline Register LessEqual(Register a, Register b) noexcept { return FromBits(a <= b ? 0xFFFFFFFFu : 0u); }
+			inline Register And(Register a, Register b) noexcept { return FromBits(ToBits(a) & ToBits(b)); }
+			inline Register Or(Register a, Register b) noexcept { return FromBits(ToBits(a) | ToBits(b)); }
+			inline Register Select(Register mask, Register a, Register b) noexcept { return ToBits(mask) ? a : b; }
+			inline unsigned MoveMask(Register mask) noexcept { return ToBits(mask) >> 31; }
+			inline void StoreMasked(float* p, Register mask, Register a) noexcept { if (MoveMask(mask)) *p = a; }
+#endif
+			const std::size_t registersPerBatch{8 / lanes};
+		}
+	}
+
+	// Eight booleans, as produced by the comparisons of `Floatx8`. Bit `i`
+	// of `ToBits()` is lane `i`.
+	struct Maskx8
+	{
+		Internal::Simd::Register registers[Internal::Simd::registersPerBatch];
+
+		friend Maskx8 operator&(const Maskx8& a, const Maskx8& b) noexcept
+		{
+			Maskx8 result;
+			for (std::size_t i{0}; i < Internal::Simd::registersPerBatch; ++i)
+				result.registers[i] = Internal::Simd::And(a.registers[i], b.registers[i]);
+			return result;
+		}
+
+		friend Maskx8 operator|(const Maskx8& a, const Maskx8& b) noexcept
+		{
+			Maskx8 result;
+			for (std::size_t i{0}; i < Internal::Simd::registersPerBatch; ++i)
+				result.registers[i] = Internal::Simd::Or(a.registers[i], b.registers[i]);
+			return result;
+		}
+
+		unsigned ToBits() const noexcept
+		{
+			unsigned bits{0};
+			for (std::size_t i{0}; i < Internal::Simd::registersPerBatch; ++i)
+				bits |= Internal::Simd::MoveMask(registers[i]) << (i * Internal::Simd::lanes);
+			return bits;
+		}
+
+		bool Any() const noexcept { return ToBits() != 0; }
+	};
+
+	// Eight floats. Loads and stores don't need any particular alignment.
+	struct Floatx8
+	{
+		Internal::Simd::Register registers[Internal::Simd::registersPerBatch];
+
+		static Floatx8 Load(const float* p) noexcept
+		{
+			Floatx8 result;
+			for (std::size_t i{0}; i < Internal::Simd::registersPerBatch; ++i)
+				result.registers[i] = Internal::Simd::Load(p + i * Internal::Simd::lanes);
+			return result;
+		}
+
+		static Floatx8 Broadcast(float value) noexcept
+		{
+			Floatx8 result;
+			for (auto& r : result.registers) r = Internal::Simd::Broadcast(value);
+			return result;
+		}
+
+		void Store(float* p) const noexcept
+		{
+			for (std::size_t i{0}; i < Internal::Simd::registersPerBatch; ++i)
+				Internal::Simd::Store(p + i * Internal::Simd::lanes, registers[i]);
+		}
+
+		// Only writes the lanes that are set in `mask`: the others aren't 
+		// even read, so another thread may own them.
+		void StoreMasked(float* p, const Maskx8& mask) const noexcept
+		{
+			for (std::size_t i{0}; i < Internal::Simd::registersPerBatch; ++i)
+				Internal::Simd::StoreMasked(p + i * Internal::Simd::lanes, mask.registers[i], registers[i]);
+		}
+
+		template<typename TOperation> 
+		static Floatx8 Apply(const Floatx8& a, const Floatx8& b, TOperation operation) noexcept
+		{
+			Floatx8 result;
+			for (std::size_t i{0}; i < Internal::Simd::registersPerBatch; ++i)
+				result.registers[i] = operation(a.registers[i], b.registers[i]);
+			return result;
+		}
+
+		template<typename TOperation> 
+		static Maskx8 Compare(const Floatx8& a, const Floatx8& b, TOperation operation) noexcept
+		{
+			Maskx8 result;
+			for (std::size_t i{0}; i < Internal::Simd::registersPerBatch; ++i)
+				result.registers[i] = operation(a.registers[i], b.registers[i]);
+			return result;
+		}
+
+		friend Floatx8 operator+(const Floatx8& a, const Floatx8& b) noexcept { return Apply(a, b, Internal::Simd::Add); }
+		friend Floatx8 operator-(const Floatx8& a, const Floatx8& b) noexcept { return Apply(a, b, Internal::Simd::Sub); }
+		friend Floatx8 operator*(const Floatx8& a, const Floatx8& b) noexcept { return Apply(a, b, Internal::Simd::Mul); }
+
+		// `a * b + c`, rounded twice like the scalar expression, so that 
+		// batched and scalar code give the very same results.
+		friend Floatx8 MulAdd(const Floatx8& a, const Floatx8& b, const Floatx8& c) noexcept { return a * b + c; }
+
+		friend Floatx8 Min(const Floatx8& a, const Floatx8& b) noexcept { return Apply(a, b, Internal::Simd::Min); }
+		friend Floatx8 Max(const Floatx8& a, const Floatx8& b) noexcept { return Apply(a, b, Internal::Simd::Max); }
+
+		friend Maskx8 operator<(const Floatx8& a, const Floatx8& b) noexcept { return Compare(a, b, Internal::Simd::Less); }
+		friend Maskx8 operator<=(const Floatx8& a, const Floatx8& b) noexcept { return Compare(a, b, Internal::Simd::LessEqual); }
+		friend Maskx8 operator>(const Floatx8& a, const Floatx8& b) noexcept { return b < a; }
+		friend Maskx8 operator>=(const Floatx8& a, const Floatx8& b) noexcept { return b <= a; }
+	};
+
+	// Eight 2D vectors, stored as two batches of coordinates.
+	struct Vec2x8
+	{
+		Floatx8 x, y;
+
+		static Vec2x8 Load(const float* xs, const float* ys) noexcept
+		{
+			return Vec2x8{ Floatx8::Load(xs), Floatx8::Load(ys) };
+		}
+
+		static Vec2x8 Broadcast(const sf::Vector2f& v) noexcept
+		{
+			return Vec2x8{ Floatx8::Broadcast(v.x), Floatx8::Broadcast(v.y) };
+		}
+
+		void Store(float* xs, float* ys) const noexcept
+		{
+			x.Store(xs);
+			y.Store(ys);
+		}
+
+		void StoreMasked(float* xs, float* ys, const Maskx8& mask) const noexcept
+		{
+			x.StoreMasked(xs, mask);
+			y.StoreMasked(ys, mask);
+		}
+
+		friend Vec2x8 operator+(const Vec2x8& a, const Vec2x8& b) noexcept { return Vec2x8{ a.x + b.x, a.y + b.y }; }
+		friend Vec2x8 operator-(const Vec2x8& a, const Vec2x8& b) noexcept { return Vec2x8{ a.x - b.x, a.y - b.y }; }
+		friend Vec2x8 operator*(const Vec2x8& a, const Floatx8& b) noexcept { return Vec2x8{ a.x * b, a.y * b }; }
+
+		friend Vec2x8 MulAdd(const Vec2x8& a, const Floatx8& b, const Vec2x8& c) noexcept
+		{
+			return Vec2x8{ MulAdd(a.x, b, c.x), MulAdd(a.y, b, c.y) };
+		}
+
+		friend Vec2x8 Min(const Vec2x8& a, const Vec2x8& b) noexcept { return Vec2x8{ Min(a.x, b.x), Min(a.y, b.y) }; }
+		friend Vec2x8 Max(const Vec2x8& a, const Vec2x8& b) noexcept { return Vec2x8{ Max(a.x, b.x), Max(a.y, b.y) }; }
+	};
 
 	// Forward declarations
 	struct Component;
@@ -35,6 +533,24 @@ namespace SpaceInvaders
 	// Name aliases for ComponentID and our group type
 	using ComponentID = std::size_t;
 	using Group = std::size_t;
+
+	// Entities get a unique, never reused ID. IDs are reserved in blocks
+	// from a single atomic counter, so managers living on different 
+	// threads only meet once every `entityIDBlockSize` entities, and 
+	// never wait for each other. 0 is not a valid ID.
+	using EntityID = std::uint64_t;
+	const std::size_t entityIDBlockSize{64};
+
+	class EntityIDAllocator
+	{
+		public:
+			// Returns the first ID of a block of `count` IDs.
+			static EntityID Reserve(std::size_t count) noexcept
+			{
+				static std::atomic<EntityID> nextID{1};
+				return nextID.fetch_add(count, std::memory_order_relaxed);
+			}
+	};
 	
 	// Let's hide implementation details into an "Internal" namespace
 	namespace Internal
@@ -48,7 +564,9 @@ namespace SpaceInvaders
 			// Basically, calling this function returns an unique ID
 			// every time.
 
-			static ComponentID lastID{ 0u };
+			// Entities are also built on worker threads, so the first 
+			// calls for different types can race: the counter is atomic.
+			static std::atomic<ComponentID> lastID{ 0u };
 			return lastID++;
 		}
 	}
@@ -85,898 +603,6451 @@ namespace SpaceInvaders
 	// And let's also typedef an `std::array` for them
 	using ComponentArray = std::array<Component*, maxComponents>;	
 
-	const std::size_t maxGroups{32};
-	using GroupBitset = std::bitset<maxGroups>;
-
-	// We begin by defining a base `Component` class.
-	// Game components will inherit from this class.
-	struct Component
-	{
-		// We will use a pointer to store the parent entity.
-		Entity* entity;
-
-		// Usually a game component will have:
-		// * Some data
-		// * Update behavior
-		// * Drawing behavior
-
-		// Therefore we define three virtual methods that
-		// will be overridden by game component types.
-		virtual void Initialize() { }
-		virtual void Update(float frameTime) { }
-		virtual void Draw() { }
-		
-		// As we'll be using this class polymorphically, it requires
-		// a virtual destructor.
-		virtual ~Component() { }
-	};
-
-	// Next, we define an Entity class. 
-	// It will basically be an aggregate of components,
-	// with some methods that help us update and draw
-	// all of them.
-	class Entity 
+#ifdef SPACE_INVADERS_VALIDATE_ACCESS
+	// A system that runs in parallel declares which components it reads
+	// and writes, and opens a `Scope` with them on the thread that runs 
+	// it. While a scope is open, `Entity::GetComponent` checks every 
+	// access against it: the `const` overload is a read, the other one a 
+	// write. Violations don't stop the game: the first one of each kind is
+	// recorded with a stack trace, and all of them are reported at exit.
+	class AccessValidator
 	{
 		private:
-			// The entity will need a reference to its manager
-			EntityManager& manager;
-
-			// We'll keep track of whether the entity is alive or dead
-			// with a boolean and we'll store the components in a private
-			// vector of `std::unique_ptr<Component>`, to allow polymorphism.
-			bool alive{true};
-			std::vector<std::unique_ptr<Component>> components;
+			// No default member initializers: Visual Studio 2015 can't 
+			// brace-initialize aggregates that have them.
+			struct Access
+			{
+				const char* system;
+				ComponentBitset reads, writes;
+			};
 
-			bool active{ true };
+			struct Violation
+			{
+				const char* system;
+				const char* component;
+				bool write;
+				std::size_t count;
+				std::vector<std::string> stackTrace;
+			};
+
+			static Access& GetCurrentAccess() noexcept
+			{
+				static thread_local Access access{ nullptr, ComponentBitset{}, ComponentBitset{} };
+				return access;
+			}
 
-			// Let's add an array to quickly get a component with 
-			// a specific ID, and a bitset to check the existance of
-			// a component with a specific ID.
-			ComponentArray componentArray;
-			ComponentBitset componentBitset;
+			static std::mutex& GetMutex()
+			{
+				static std::mutex mutex;
+				return mutex;
+			}
 
-			// Let's add a bitset to our entities.
-			GroupBitset groupBitset;
+			static std::vector<Violation>& GetViolations()
+			{
+				static std::vector<Violation> violations;
+				return violations;
+			}
 
-		// Now we will define some public methods to update and
-		// draw, to add components and to destroy the entity.
-		public:
-			Entity(EntityManager& manager) : manager(manager) { }
+			static std::vector<std::string> CaptureStackTrace()
+			{
+				std::vector<std::string> result;
+				void* frames[32];
 
-			// Updating and drawing simply consists in updating and drawing
-			// all the components.
-			void Update(float frameTime) 	
-			{ 
-				for(auto& c : components) 
-					c->Update(frameTime); 
+#ifdef _WIN32
+				auto count(CaptureStackBackTrace(2, 32, frames, nullptr));
+				for (USHORT i{0}; i < count; ++i)
+				{
+					std::ostringstream frame;
+					frame << frames[i];
+					result.emplace_back(frame.str());
+				}
+#else
+				auto count(backtrace(frames, 32));
+				auto symbols(backtrace_symbols(frames, count));
+				if (symbols == nullptr) return result;
+
+				for (int i{2}; i < count; ++i) result.emplace_back(symbols[i]);
+				std::free(symbols);
+#endif
+				return result;
 			}
 
-			void Draw() 		
-			{ 
-				for(auto& c : components) 
-					c->Draw(); 
-			}
+			static void Record(const char* component, bool write)
+			{
+				auto& access(GetCurrentAccess());
+				std::lock_guard<std::mutex> lock{ GetMutex() };
+				auto& violations(GetViolations());
 
-			// We will also define some methods to control the lifetime
-			// of the entity.
-			bool IsAlive() const 	
-			{ 
-				return alive; 
-			}
+				for (auto& violation : violations)
+				{
+					if (violation.system == access.system && violation.component == component 
+						&& violation.write == write)
+					{
+						++violation.count;
+						return;
+					}
+				}
 
-			void Destroy() 			
-			{ 
-				alive = false; 
+				violations.emplace_back(Violation{ access.system, component, write, 1, CaptureStackTrace() });
 			}
 
-			bool IsActive() const
+		public:
+			// Scopes can be nested: the outer one is back when the inner 
+			// one closes.
+			class Scope
 			{
-				return active;
-			}
-			
-			void Enable()
+				private:
+					Access previous;
+
+				public:
+					Scope(const char* system, const ComponentBitset& reads, const ComponentBitset& writes)
+						: previous(GetCurrentAccess())
+					{
+						GetCurrentAccess() = Access{ system, reads | writes, writes };
+					}
+
+					~Scope() { GetCurrentAccess() = previous; }
+
+					Scope(const Scope&) = delete;
+					Scope& operator=(const Scope&) = delete;
+			};
+
+			static void CheckRead(ComponentID id, const char* component)
 			{
-				active = true;
+				auto& access(GetCurrentAccess());
+				if (access.system != nullptr && !access.reads[id]) Record(component, false);
 			}
 
-			void Disable()
+			static void CheckWrite(ComponentID id, const char* component)
 			{
-				active = false;
+				auto& access(GetCurrentAccess());
+				if (access.system != nullptr && !access.writes[id]) Record(component, true);
 			}
 
-			// To check if this entity has a component, we simply
-			// query the bitset.
-			template<typename T> bool HasComponent() const
+			static void Report(std::ostream& stream)
 			{
-				return componentBitset[GetComponentTypeID<T>()];
+				std::lock_guard<std::mutex> lock{ GetMutex() };
+
+				for (auto& violation : GetViolations())
+				{
+					stream << "Undeclared " << (violation.write ? "write to " : "read of ") 
+						<< violation.component << " in " << violation.system 
+						<< " (" << violation.count << " times), first at:\n";
+
+					for (auto& frame : violation.stackTrace) stream << "    " << frame << "\n";
+				}
 			}
+	};
+#endif
 
-			// Groups will be handled at runtime, not compile-time:
-			// therefore we will pass groups as a function argument.
-			bool HasGroup(Group group) const noexcept
-			{ 
-				return groupBitset[group]; 
-			}
-
-			// To add/remove group we define some methods that alter
-			// the bitset and tell the manager what we're doing,
-			// so that the manager can internally store this entity 
-			// in its grouped containers. 
-			// We'll need to define this method after the definition
-			// of `Manager`, as we're gonna call `EntityManager::AddtoGroup` here.
-			void AddGroup(Group group) noexcept;
-
-			void DelGroup(Group group) noexcept
-			{ 
-				groupBitset[group] = false;
-				// We won't notify the manager that a group has been
-				// removed here, as it will automatically remove 
-				// entities from the "wrong" group containers during
-				// refresh.
-			} 
+	const std::size_t maxGroups{32};
+	using GroupBitset = std::bitset<maxGroups>;
 
-			// Now, we'll define a method that allows us to add components
-			// to our entity.
-			// We'll take advantage of C++11 variadic templates and emplacement
-			// to directly construct our components in place.
-			// `T` is the component type. `TArgs` is a parameter pack of 
-			// types used to construct the component.
-			template<typename T, typename... TArgs> 
-			T& AddComponent(TArgs&&... args)
-			{
-				// Before adding a component, we make sure it doesn't
-				// already exist by using an assertion.
-				assert(!HasComponent<T>());
+	// World-level singletons (the render queue, the texture cache, the
+	// projectile pool...) are resources. Rather than being handed pointers
+	// to them when they are created, components look them up in the 
+	// registry of their entity's world when they need them, so they only 
+	// store ids and values. Systems that use a resource for every entity
+	// of every frame hold on to it themselves. Resource IDs are handed out
+	// the same way as component IDs.
+	using ResourceID = std::size_t;
+	const std::size_t maxResources{16};
 
-				// We begin by allocating the component of type `T`
-				// on the heap, by forwarding the passed arguments
-				// to its constructor.
-				T* c(new T(std::forward<TArgs>(args)...));
-				
-				// We set the component's entity to the current
-				// instance.
-				c->entity = this;
+	namespace Internal
+	{
+		inline ResourceID GetUniqueResourceID() noexcept
+		{
+			static std::atomic<ResourceID> lastID{ 0u };
+			return lastID++;
+		}
+	}
 
-				// We will wrap the raw pointer into a smart one,
-				// so that we can emplace it into our container and 
-				// to make sure we do not leak any memory.
-				std::unique_ptr<Component> uPtr{c};
+	template<typename T> inline ResourceID GetResourceTypeID() noexcept
+	{
+		static ResourceID typeID{Internal::GetUniqueResourceID()};
+		return typeID;
+	}
 
-				// Now we'll add the smart pointer to our container:
-				// `std::move` is required, as `std::unique_ptr` cannot
-				// be copied.
-				components.emplace_back(std::move(uPtr));
-				
-				// When we add a component of type `T`, we add it to 
-				// the array and to the bitset.
-				componentArray[GetComponentTypeID<T>()] = c;
-				componentBitset[GetComponentTypeID<T>()] = true;
-				
-				// We can now call `Component::Initialize()`:
-				c->Initialize();
+	class ResourceRegistry
+	{
+		private:
+			std::array<void*, maxResources> resources{};
 
-				// ...and we will return a reference to the newly added
-				// component, in case the user wants to do something
-				// with it.
-				return *c;
+		public:
+			// The registry doesn't own its resources: they must outlive
+			// every entity of the world.
+			template<typename T> void Add(T& resource) noexcept
+			{
+				assert(GetResourceTypeID<T>() < maxResources);
+				resources[GetResourceTypeID<T>()] = &resource;
 			}
 
-			template<typename T> T& GetComponent() const
+			template<typename T> T& Get() const noexcept
 			{
-				// To retrieve a specific component, we get it from
-				// the array. We'll also assert its existance.
-
-				assert(HasComponent<T>());
-				auto ptr(componentArray[GetComponentTypeID<T>()]);
-				return *reinterpret_cast<T*>(ptr);
+				assert(resources[GetResourceTypeID<T>()] != nullptr);
+				return *static_cast<T*>(resources[GetResourceTypeID<T>()]);
 			}
 	};
 
-	// Even if the `Entity` class may seem complex, conceptually it is
-	// very simple. Just think of an entity as a container for components,
-	// with syntatic sugar methods to quicky add/update/draw components.
-
-	// If `Entity` is an aggregate of components, `EntityManager` is an aggregate
-	// of entities. Implementation is straightforward, and resembles the 
-	// previous one.
-	class EntityManager
+	// Observers of structural changes get a whole batch of entities.
+	using Observer = std::function<void(const std::vector<Entity*>&)>;
+
+	// Entities with the same set of components share an archetype. The 
+	// archetypes form a graph: adding component `C` to an entity of 
+	// archetype `A` leads to the archetype of `A | C`. Edges are looked up
+	// in a hash map the first time they are taken and cached in the node 
+	// afterwards, so transitions are a couple of array accesses. Like 
+	// component IDs, archetype IDs are global: they mean the same thing 
+	// in every manager.
+	// Managers living on different threads share the graph, so it has to
+	// be safe to share: nodes live in a fixed-size array that never moves,
+	// cached edges are atomics read without locking, and only a missing 
+	// edge takes the lock to fill it in.
+	using ArchetypeID = std::uint32_t;
+	const ArchetypeID emptyArchetype{0}, noArchetype{0xFFFFFFFFu};
+	const std::size_t maxArchetypes{256};
+
+	class ArchetypeGraph
 	{
 		private:
-			std::vector<std::unique_ptr<Entity>> entities;
+			struct Node
+			{
+				ComponentBitset signature;
+				std::array<std::atomic<ArchetypeID>, maxComponents> addEdges, removeEdges;
+			};
 
-			// We store entities in groups by creating "group buckets" in an 
-			// array. `std::vector<Entity*>` could be also replaced for 
-			// `std::set<Entity*>`.
-			std::array<std::vector<Entity*>, maxGroups> groupedEntities;
+			std::unique_ptr<Node[]> nodes{new Node[maxArchetypes]};
+			std::size_t nodeCount{0};
+			std::unordered_map<unsigned long, ArchetypeID> lookup;
+			std::mutex mutex;
 
-		public:
-			void Update(float frameTime) 	
+			ArchetypeGraph() 
 			{ 
-				for (auto& e : entities)
-				{
-					if (e->IsActive())
-					{
-						e->Update(frameTime);
-					}
-				}
+				Find(ComponentBitset{}); 
 			}
 
-			void Draw() 			
-			{ 
-				for (auto& e : entities)
+			static ArchetypeGraph& GetInstance()
+			{
+				static ArchetypeGraph instance;
+				return instance;
+			}
+
+			// Called with `mutex` held (or from the constructor).
+			ArchetypeID Find(const ComponentBitset& signature)
+			{
+				auto inserted(lookup.emplace(signature.to_ulong(), static_cast<ArchetypeID>(nodeCount)));
+				if (inserted.second)
 				{
-					if (e->IsActive())
+					// Checked in every build: there is no way to go on past
+					// the end of `nodes`.
+					if (nodeCount == maxArchetypes)
 					{
-						e->Draw();
+						std::cerr << "Too many archetypes: maxArchetypes must be raised\n";
+						std::abort();
 					}
+
+					auto& node(nodes[nodeCount++]);
+					node.signature = signature;
+					for (auto& edge : node.addEdges) edge.store(noArchetype, std::memory_order_relaxed);
+					for (auto& edge : node.removeEdges) edge.store(noArchetype, std::memory_order_relaxed);
 				}
+
+				return inserted.first->second;
 			}
 
-			// When we add a group to an entity, we just add it to the
-			// correct "group bucket".
-			void AddToGroup(Entity* entity, Group group)
+			// Both directions of an edge are cached at once. The release
+			// stores publish the new node's signature to lock-free readers.
+			void Link(ArchetypeID from, ArchetypeID to, ComponentID id)
 			{
-				// It would be wise to either assert that the bucket doesn't
-				// already contain `entity`, or use a set to prevent duplicates
-				// in exchange for less efficient insertion/iteration.
-
-				groupedEntities[group].emplace_back(entity);
+				nodes[from].addEdges[id].store(to, std::memory_order_release);
+				nodes[to].removeEdges[id].store(from, std::memory_order_release);
 			}
 
-			// To get entities that belong to a certain group, we can simply
-			// get one of the "buckets" from the array.
-			std::vector<Entity*>& GetEntitiesByGroup(Group group)
+		public:
+			static ArchetypeID GetAddTransition(ArchetypeID from, ComponentID id)
 			{
-				return groupedEntities[group];
+				auto& graph(GetInstance());
+				auto to(graph.nodes[from].addEdges[id].load(std::memory_order_acquire));
+				if (to != noArchetype) return to;
+
+				std::lock_guard<std::mutex> lock{graph.mutex};
+				auto signature(graph.nodes[from].signature);
+				signature[id] = true;
+				to = graph.Find(signature);
+				graph.Link(from, to, id);
+
+				return to;
 			}
 
-			// During refresh, we need to remove dead entities and entities
-			// with incorrect groups from the buckets.
-			void Refresh()
+			static ArchetypeID GetRemoveTransition(ArchetypeID from, ComponentID id)
 			{
-				for(auto i(0u); i < maxGroups; ++i)
-				{
-					auto& v(groupedEntities[i]);
+				auto& graph(GetInstance());
+				auto to(graph.nodes[from].removeEdges[id].load(std::memory_order_acquire));
+				if (to != noArchetype) return to;
 
-					v.erase(
-						std::remove_if(std::begin(v), std::end(v), 
-						[i](Entity* entity) 
-						{ 
-							return !entity->IsAlive() || !entity->HasGroup(i); 
-						}), 
-						std::end(v));
-				}
+				std::lock_guard<std::mutex> lock{graph.mutex};
+				auto signature(graph.nodes[from].signature);
+				signature[id] = false;
+				to = graph.Find(signature);
+				graph.Link(to, from, id);
 
-				// Cleaning up "dead" entities.
-				entities.erase(
-					std::remove_if(std::begin(entities), std::end(entities), 
-					[](const std::unique_ptr<Entity>& entity) 
-					{ 
-						return !entity->IsAlive(); 
-					}), 
-					std::end(entities));
+				return to;
 			}
 
-			Entity& AddEntity()
-			{				
-				Entity* e(new Entity(*this));
-				std::unique_ptr<Entity> uPtr{e};
-				entities.emplace_back(std::move(uPtr));
-				return *e;
-			}	
+			static ComponentBitset GetSignature(ArchetypeID id)
+			{
+				return GetInstance().nodes[id].signature;
+			}
 	};
 
-	// Here's the definition of `Entity::addToGroup`
-	void Entity::AddGroup(Group group) noexcept
+	// A named shared memory mapping: the game creates it, and other
+	// processes can open it (read-only) to look at what's going on.
+	class SharedMemory
 	{
-		groupBitset[group] = true;
-		manager.AddToGroup(this, group);
-	}
+		private:
+			void* data{nullptr};
+			std::size_t size{0};
 
-	//
-	// Let's create the components for our Space Invaders clone
-	//
-	using FrameTime = float;
+#ifdef _WIN32
+			HANDLE mapping{nullptr};
+#else
+			std::string name;
+			bool owner{false};
+#endif
 
-	const int windowWidth{800}, windowHeight{600};
-	const float playerShipWidth{66.f}, playerShipHeight{50.f}, playerShipVelocity{0.6f};
-	const float enemyShipWidth{ 69.3f }, enemyShipHeight{ 56.f }, enemyShipVelocity{ 0.05f };
-	const float	bulletWidth{ 9.f }, bulletHeight{ 37.f }, bulletVelocity{ 0.5f };
-	const int maxPlayerBullets{ 6 }, maxEnemyBullets{ 36 };
-	const int countEnemyColumn{9}, countEnemyRow{4};
-	const float ftStep{1.f}, ftSlice{1.f};
+		public:
+			SharedMemory() = default;
+			SharedMemory(const SharedMemory&) = delete;
+			SharedMemory& operator=(const SharedMemory&) = delete;
 
-	// Forward declaration
-	struct Game;
+			~SharedMemory()
+			{
+#ifdef _WIN32
+				if (data != nullptr) UnmapViewOfFile(data);
+				if (mapping != nullptr) CloseHandle(mapping);
+#else
+				if (data != nullptr) munmap(data, size);
+				if (owner) shm_unlink(name.c_str());
+#endif
+			}
 
-	// Entities can have a position in the game world.
-	struct Transform : Component
-	{
-		sf::Vector2f position;
+			bool Create(const std::string& segmentName, std::size_t segmentSize)
+			{
+				size = segmentSize;
+#ifdef _WIN32
+				mapping = CreateFileMappingA(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE, 
+					0, static_cast<DWORD>(size), segmentName.c_str());
+				if (mapping == nullptr) return false;
+
+				data = MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, size);
+#else
+				name = "/" + segmentName;
+				auto descriptor(shm_open(name.c_str(), O_CREAT | O_RDWR, 0600));
+				if (descriptor < 0) return false;
+
+				owner = true;
+				if (ftruncate(descriptor, static_cast<off_t>(size)) == 0)
+				{
+					data = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, descriptor, 0);
+					if (data == MAP_FAILED) data = nullptr;
+				}
+				close(descriptor);
+#endif
+				return data != nullptr;
+			}
 
-		Transform() = default;
-		Transform(const sf::Vector2f& position) : position{ position } { }
+			bool Open(const std::string& segmentName, std::size_t segmentSize)
+			{
+				size = segmentSize;
+#ifdef _WIN32
+				mapping = OpenFileMappingA(FILE_MAP_READ, FALSE, segmentName.c_str());
+				if (mapping == nullptr) return false;
+
+				data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, size);
+#else
+				name = "/" + segmentName;
+				auto descriptor(shm_open(name.c_str(), O_RDONLY, 0));
+				if (descriptor < 0) return false;
+
+				data = mmap(nullptr, size, PROT_READ, MAP_SHARED, descriptor, 0);
+				if (data == MAP_FAILED) data = nullptr;
+				close(descriptor);
+#endif
+				return data != nullptr;
+			}
 
-		float x() const noexcept { return position.x; }
-		float y() const noexcept { return position.y; }
+			void* GetData() const noexcept { return data; }
 	};
 
-	// Entities can have a physical body and a velocity.
-	struct Physics : Component
+	// A read-only view of a whole file. The file is mapped in memory, so
+	// only the pages that are actually looked at get loaded.
+	class MappedFile
 	{
-		Transform* transform{nullptr};
-		sf::Vector2f velocity, halfSize;
+		private:
+			const std::uint8_t* data{nullptr};
+			std::size_t size{0};
 
-		// We will use a callback to handle the "out of bounds" event.
-		std::function<void(const sf::Vector2f&)> onOutOfBounds;
+#ifdef _WIN32
+			HANDLE file{INVALID_HANDLE_VALUE}, mapping{nullptr};
+#endif
 
-		Physics(const sf::Vector2f& halfSize) : halfSize{ halfSize } { }
+		public:
+			MappedFile() = default;
+			MappedFile(const MappedFile&) = delete;
+			MappedFile& operator=(const MappedFile&) = delete;
 
-		void Initialize() override
-		{	
-			// A requirement for `Physics` is obviously `Transform`.
-			transform = &entity->GetComponent<Transform>();
-		}
+			~MappedFile()
+			{
+#ifdef _WIN32
+				if (data != nullptr) UnmapViewOfFile(data);
+				if (mapping != nullptr) CloseHandle(mapping);
+				if (file != INVALID_HANDLE_VALUE) CloseHandle(file);
+#else
+				if (data != nullptr) munmap(const_cast<std::uint8_t*>(data), size);
+#endif
+			}
 
-		void Update(float frameTime) override
-		{
-			transform->position += velocity * frameTime;
+			bool Open(const std::string& filename)
+			{
+#ifdef _WIN32
+				file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, 
+					nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+				if (file == INVALID_HANDLE_VALUE) return false;
 
-			if(onOutOfBounds == nullptr) return;
+				LARGE_INTEGER fileSize;
+				if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0) return false;
+				size = static_cast<std::size_t>(fileSize.QuadPart);
 
-			if (left() < 0) 
-				onOutOfBounds(sf::Vector2f{ 1.f, 0.f });
-			else if (right() > windowWidth) 
-				onOutOfBounds(sf::Vector2f{ -1.f, 0.f });
+				mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+				if (mapping == nullptr) return false;
 
-			if (top() < 0) 
-				onOutOfBounds(sf::Vector2f{ 0.f, 1.f });
-			else if (bottom() > windowHeight) 
-				onOutOfBounds(sf::Vector2f{ 0.f, -1.f });
-		}
+				data = static_cast<const std::uint8_t*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+#else
+				auto descriptor(open(filename.c_str(), O_RDONLY));
+				if (descriptor < 0) return false;
+
+				struct stat status;
+				if (fstat(descriptor, &status) == 0 && status.st_size > 0)
+				{
+					size = static_cast<std::size_t>(status.st_size);
 
-		float x() 		const  noexcept { return transform->x(); }
-		float y() 		const  noexcept { return transform->y(); }
-		float left() 	const  noexcept { return x() - halfSize.x; }
-		float right() 	const  noexcept { return x() + halfSize.x; }
-		float top() 	const  noexcept { return y() - halfSize.y; }
-		float bottom() 	const  noexcept { return y() + halfSize.y; }
+					auto view(mmap(nullptr, size, PROT_READ, MAP_PRIVATE, descriptor, 0));
+					if (view != MAP_FAILED) data = static_cast<const std::uint8_t*>(view);
+				}
+				close(descriptor);
+#endif
+				return data != nullptr;
+			}
 
-		void SetY(float yValue) { transform->position.y = yValue; }
+			const std::uint8_t* GetData() const noexcept { return data; }
+			std::size_t GetSize() const noexcept { return size; }
 	};
 
-	// An entity can have a rectangular shape 
-	// that can be rendered on screen.
-	struct RectangleRenderer : Component
+	// The world inspector is a debug mode where entities, transforms and
+	// physics components are allocated inside a shared memory segment 
+	// instead of the heap. The segment starts with a self-describing type 
+	// table (slot size, slot count and the offset of every interesting 
+	// field), so an external process can read the live data in place, 
+	// without any serialization.
+	// Each update makes the epoch odd while it runs and even when it's 
+	// done: readers check that the epoch didn't change while they looked.
+	enum class InspectedType : std::uint32_t
 	{
-		Game* game{nullptr};
-		Transform* transform{nullptr};
-		sf::RectangleShape shape;
-		sf::Vector2f size;
-		std::string textureFilename;
-		sf::Texture texture;
+		Entity,
+		Transform,
+		Physics,
+		Count
+	};
 
-		RectangleRenderer(Game* game, const sf::Vector2f& halfSize, const std::string& textureFilename)
-			: game{ game }, size{ halfSize * 2.f }, textureFilename{ textureFilename } {}
-		
-		void Initialize() override
-		{	
-			transform = &entity->GetComponent<Transform>();
+	enum class InspectedFieldType : std::uint32_t
+	{
+		Bool,
+		Float2,
+		Bits32,
+		Fixed2 // Two Q16.16 numbers
+	};
 
-			shape.setSize(size);
-			shape.setFillColor(sf::Color::White);
-			shape.setOrigin(size.x / 2.f, size.y / 2.f);
-			
-			texture.loadFromFile(textureFilename);
-			shape.setTexture(&texture);
-		}
+	struct InspectorField
+	{
+		char name[24];
+		std::uint32_t type;
+		std::uint32_t offset;
+	};
 
-		void Update(float frameTime) override
-		{
-			shape.setPosition(transform->position);
-		}
+	struct InspectorTypeInfo
+	{
+		char name[24];
+		std::uint32_t slotSize, slotCount;
+		std::uint64_t slotsOffset, occupancyOffset;
+		std::uint32_t fieldCount;
+		InspectorField fields[4];
+	};
 
-		void Draw() override;
+	struct InspectorHeader
+	{
+		static constexpr std::uint32_t expectedMagic{0x53495749}, expectedVersion{2};
+
+		std::uint32_t magic;
+		std::uint32_t version;
+		std::uint64_t segmentSize;
+		std::atomic<std::uint32_t> epoch;
+		std::uint32_t typeCount;
+		InspectorTypeInfo types[static_cast<std::size_t>(InspectedType::Count)];
+
+		// Objects that didn't fit in their pool, and live on the heap 
+		// where the inspector can't see them.
+		std::atomic<std::uint32_t> overflowCounts[static_cast<std::size_t>(InspectedType::Count)];
 	};
 
-	// The player ship needs a component to manage
-	// keyboard input.
-	struct PlayerController : Component
+	class WorldInspector
 	{
-		Transform* transform{ nullptr };
-		Physics* physics{nullptr};
-		Game* game{ nullptr };
-		EntityManager* manager{ nullptr };
-		int currentPlayerBullet;
+		private:
+			// Slots are handed out from a free list that lives in process
+			// memory; only the slots and their occupancy flags are shared.
+			struct Pool
+			{
+				char* slots{nullptr};
+				std::uint8_t* occupancy{nullptr};
+				std::size_t slotSize{0}, slotCount{0};
+				std::vector<std::uint32_t> freeSlots;
+				std::mutex mutex;
+			};
+
+			static std::unique_ptr<WorldInspector>& GetInstance()
+			{
+				static std::unique_ptr<WorldInspector> instance;
+				return instance;
+			}
 
-		float const fireRate = 1000.f; // In milliseconds
-		float accumulatedTime = fireRate + 1.f;
-		
-		PlayerController(Game* game, EntityManager* manager, int& currentPlayerBullet)
-			: game{ game } , manager{ manager }, currentPlayerBullet{ currentPlayerBullet }   {}
+			SharedMemory memory;
+			InspectorHeader* header{nullptr};
+			std::array<Pool, static_cast<std::size_t>(InspectedType::Count)> pools;
 
-		void Initialize() override
-		{	
-			// A requirement for `PlayerController` is `Transform` and 'Physics'
-			transform = &entity->GetComponent<Transform>();
-			physics = &entity->GetComponent<Physics>();
-		}
+			bool Initialize();
 
-		void Update(FrameTime frameTime)
-		{
-			if (sf::Keyboard::isKeyPressed(sf::Keyboard::Key::Left) && 
-				physics->left() > 0)
+			void* AllocateSlot(InspectedType type, std::size_t size)
 			{
-				physics->velocity.x = -playerShipVelocity;
+				auto& pool(pools[static_cast<std::size_t>(type)]);
+				if (size > pool.slotSize) return nullptr;
+
+				std::lock_guard<std::mutex> lock{ pool.mutex };
+				if (pool.freeSlots.empty()) return nullptr;
+
+				auto slot(pool.freeSlots.back());
+				pool.freeSlots.pop_back();
+				pool.occupancy[slot] = 1;
+				return pool.slots + slot * pool.slotSize;
 			}
-			else if (sf::Keyboard::isKeyPressed(sf::Keyboard::Key::Right) && 
-				physics->right() < windowWidth)
+
+			bool FreeSlot(InspectedType type, void* pointer)
 			{
-				physics->velocity.x = playerShipVelocity;
+				auto& pool(pools[static_cast<std::size_t>(type)]);
+				auto address(static_cast<char*>(pointer));
+
+				if (address < pool.slots || address >= pool.slots + pool.slotSize * pool.slotCount)
+					return false;
+
+				auto slot(static_cast<std::uint32_t>((address - pool.slots) / pool.slotSize));
+
+				std::lock_guard<std::mutex> lock{ pool.mutex };
+				pool.occupancy[slot] = 0;
+				pool.freeSlots.emplace_back(slot);
+				return true;
 			}
-			else 
+
+		public:
+			// Must be called before any entity is created.
+			static bool Start()
 			{
-				physics->velocity.x = 0;
+				std::unique_ptr<WorldInspector> inspector{ new WorldInspector };
+				if (!inspector->Initialize()) return false;
+
+				GetInstance() = std::move(inspector);
+				return true;
 			}
 
-			accumulatedTime += frameTime;
+			// Inspected types route their `operator new`/`operator delete`
+			// here. When the inspector isn't running (or a pool is full)
+			// the regular heap is used. Overflows are counted, so that the
+			// inspector and the stats can tell what's missing.
+			static void* Allocate(InspectedType type, std::size_t size)
+			{
+				auto& instance(GetInstance());
+				if (instance == nullptr) return ::operator new(size);
 
-			if (sf::Keyboard::isKeyPressed(sf::Keyboard::Key::Space))
-			{			
-				if (accumulatedTime > fireRate)
-				{
-					UsePlayerShipWeapon(transform->position, currentPlayerBullet);
+				auto pointer(instance->AllocateSlot(type, size));
+				if (pointer != nullptr) return pointer;
+
+				instance->header->overflowCounts[static_cast<std::size_t>(type)].fetch_add(1, std::memory_order_relaxed);
+				return ::operator new(size);
+			}
+
+			static void Deallocate(InspectedType type, void* pointer)
+			{
+				auto& instance(GetInstance());
+				if (instance == nullptr || !instance->FreeSlot(type, pointer))
+					::operator delete(pointer);
+			}
+
+			// Everything that creates, changes or frees inspected objects 
+			// must happen between these two calls.
+			static void BeginUpdate() noexcept
+			{
+				auto& instance(GetInstance());
+				if (instance != nullptr) instance->header->epoch.fetch_add(1, std::memory_order_acq_rel);
+			}
+
+			static void EndUpdate() noexcept
+			{
+				auto& instance(GetInstance());
+				if (instance != nullptr) instance->header->epoch.fetch_add(1, std::memory_order_release);
+			}
+
+			// Total number of objects that didn't fit in their pool.
+			static std::uint32_t GetOverflowCount() noexcept
+			{
+				auto& instance(GetInstance());
+				if (instance == nullptr) return 0;
+
+				std::uint32_t total{0};
+				for (auto& count : instance->header->overflowCounts) total += count.load(std::memory_order_relaxed);
+				return total;
+			}
+	};
+
+	// We begin by defining a base `Component` class.
+	// Game components will inherit from this class.
+	struct Component
+	{
+		// We will use a pointer to store the parent entity.
+		Entity* entity;
+
+		// Usually a game component will have:
+		// * Some data
+		// * Update behavior
+		// * Drawing behavior
+
+		// Therefore we define three virtual methods that
+		// will be overridden by game component types.
+		virtual void Initialize() { }
+		virtual void Update(float frameTime) { }
+		virtual void Draw() { }
+		
+		// As we'll be using this class polymorphically, it requires
+		// a virtual destructor.
+		virtual ~Component() { }
+	};
+
+	// Next, we define an Entity class. 
+	// It will basically be an aggregate of components,
+	// with some methods that help us update and draw
+	// all of them.
+	class Entity 
+	{
+		private:
+			// The entity will need a pointer to its manager. It's a pointer
+			// rather than a reference because entities can be built in one
+			// manager and later handed over to another one.
+			EntityManager* manager;
+
+			// We'll keep track of whether the entity is alive or dead
+			// with a boolean and we'll store the components in a private
+			// vector of `std::unique_ptr<Component>`, to allow polymorphism.
+			bool alive{true};
+			std::vector<std::unique_ptr<Component>> components;
+
+			bool active{ true };
+
+			// Let's add an array to quickly get a component with 
+			// a specific ID, and a bitset to check the existance of
+			// a component with a specific ID.
+			ComponentArray componentArray;
+			ComponentBitset componentBitset;
+
+			// Let's add a bitset to our entities.
+			GroupBitset groupBitset;
+
+			// The group buckets the entity is in. An entity stays in a 
+			// bucket until the refresh after it left the group, so this 
+			// can differ from `groupBitset`.
+			GroupBitset bucketBitset;
+
+			// Where the entity is stored in its manager's archetype buckets.
+			ArchetypeID archetype{emptyArchetype};
+			std::uint32_t archetypeRow{0};
+
+			EntityID id{0};
+
+			// Where the entity is in its manager's bitsets.
+			std::uint32_t slot{0};
+
+		// Now we will define some public methods to update and
+		// draw, to add components and to destroy the entity.
+			friend class EntityManager;
+			friend class WorldInspector;
+
+		public:
+			Entity(EntityManager& manager) : manager(&manager) { }
+
+			static void* operator new(std::size_t size) 
+			{ 
+				return WorldInspector::Allocate(InspectedType::Entity, size); 
+			}
+
+			static void operator delete(void* pointer) 
+			{ 
+				WorldInspector::Deallocate(InspectedType::Entity, pointer); 
+			}
+
+			// Updating and drawing simply consists in updating and drawing
+			// all the components.
+			void Update(float frameTime) 	
+			{ 
+				for(auto& c : components) 
+					c->Update(frameTime); 
+			}
+
+			void Draw() 		
+			{ 
+				for(auto& c : components) 
+					c->Draw(); 
+			}
+
+			EntityID GetID() const noexcept
+			{
+				return id;
+			}
+
+			// We will also define some methods to control the lifetime
+			// of the entity.
+			bool IsAlive() const 	
+			{ 
+				return alive; 
+			}
+
+			// The manager mirrors these flags in its bitsets, so they are 
+			// defined after `EntityManager`.
+			void Destroy() noexcept;
+
+			bool IsActive() const
+			{
+				return active;
+			}
+			
+			void Enable() noexcept;
+			void Disable() noexcept;
+
+			// To check if this entity has a component, we simply
+			// query the bitset.
+			template<typename T> bool HasComponent() const
+			{
+				return componentBitset[GetComponentTypeID<T>()];
+			}
+
+			// Groups will be handled at runtime, not compile-time:
+			// therefore we will pass groups as a function argument.
+			bool HasGroup(Group group) const noexcept
+			{ 
+				return groupBitset[group]; 
+			}
+
+			// To add/remove group we define some methods that alter
+			// the bitset and tell the manager what we're doing,
+			// so that the manager can internally store this entity 
+			// in its grouped containers. 
+			// We'll need to define this method after the definition
+			// of `Manager`, as we're gonna call `EntityManager::AddtoGroup` here.
+			void AddGroup(Group group) noexcept;
+
+			// Same as above: they need the definition of `EntityManager`.
+			void NotifyComponentAdded(ComponentID id);
+			void NotifyComponentRemoved(ComponentID id);
+
+			// Resources of the world this entity belongs to.
+			template<typename T> T& GetResource() const;
+
+			// We won't notify the manager's group containers that a group 
+			// has been removed, as it will automatically remove entities 
+			// from the "wrong" group containers during refresh. Only the
+			// group bitset is updated right away.
+			void DelGroup(Group group) noexcept;
+
+			// Now, we'll define a method that allows us to add components
+			// to our entity.
+			// We'll take advantage of C++11 variadic templates and emplacement
+			// to directly construct our components in place.
+			// `T` is the component type. `TArgs` is a parameter pack of 
+			// types used to construct the component.
+			template<typename T, typename... TArgs> 
+			T& AddComponent(TArgs&&... args)
+			{
+				// Before adding a component, we make sure it doesn't
+				// already exist by using an assertion.
+				assert(!HasComponent<T>());
+
+				// We begin by allocating the component of type `T`
+				// on the heap, by forwarding the passed arguments
+				// to its constructor.
+				T* c(new T(std::forward<TArgs>(args)...));
+				
+				// We set the component's entity to the current
+				// instance.
+				c->entity = this;
+
+				// We will wrap the raw pointer into a smart one,
+				// so that we can emplace it into our container and 
+				// to make sure we do not leak any memory.
+				std::unique_ptr<Component> uPtr{c};
+
+				// Now we'll add the smart pointer to our container:
+				// `std::move` is required, as `std::unique_ptr` cannot
+				// be copied.
+				components.emplace_back(std::move(uPtr));
+				
+				// When we add a component of type `T`, we add it to 
+				// the array and to the bitset.
+				componentArray[GetComponentTypeID<T>()] = c;
+				componentBitset[GetComponentTypeID<T>()] = true;
+				
+				// We can now call `Component::Initialize()`:
+				c->Initialize();
+
+				// Observers are told about the new component at the next
+				// refresh of the manager.
+				NotifyComponentAdded(GetComponentTypeID<T>());
+
+				// ...and we will return a reference to the newly added
+				// component, in case the user wants to do something
+				// with it.
+				return *c;
+			}
+
+			// Components are destroyed right away. Removing a component 
+			// other components depend on (e.g. `Transform`, which `Physics`
+			// points to) is up to the caller.
+			template<typename T> void RemoveComponent()
+			{
+				assert(HasComponent<T>());
+
+				auto id(GetComponentTypeID<T>());
+				auto c(componentArray[id]);
+
+				components.erase(std::find_if(std::begin(components), std::end(components),
+					[c](const std::unique_ptr<Component>& component) { return component.get() == c; }));
+
+				componentArray[id] = nullptr;
+				componentBitset[id] = false;
+
+				NotifyComponentRemoved(id);
+			}
+
+			template<typename T> T& GetComponent()
+			{
+				// To retrieve a specific component, we get it from
+				// the array. We'll also assert its existance.
+
+				assert(HasComponent<T>());
+#ifdef SPACE_INVADERS_VALIDATE_ACCESS
+				AccessValidator::CheckWrite(GetComponentTypeID<T>(), typeid(T).name());
+#endif
+				auto ptr(componentArray[GetComponentTypeID<T>()]);
+				return *reinterpret_cast<T*>(ptr);
+			}
+
+			// Through a `const` entity, components can only be read.
+			template<typename T> const T& GetComponent() const
+			{
+				assert(HasComponent<T>());
+#ifdef SPACE_INVADERS_VALIDATE_ACCESS
+				AccessValidator::CheckRead(GetComponentTypeID<T>(), typeid(T).name());
+#endif
+				auto ptr(componentArray[GetComponentTypeID<T>()]);
+				return *reinterpret_cast<const T*>(ptr);
+			}
+	};
+
+	// Even if the `Entity` class may seem complex, conceptually it is
+	// very simple. Just think of an entity as a container for components,
+	// with syntatic sugar methods to quicky add/update/draw components.
+
+	// Some work (spawning or freeing thousands of entities) is too expensive
+	// to be done in a single frame. `FrameBudget` lets that work be sliced:
+	// it's created at the beginning of a frame with an amount of milliseconds,
+	// and the work is interrupted as soon as the budget is exhausted.
+	class FrameBudget
+	{
+		private:
+			using Clock = std::chrono::high_resolution_clock;
+
+			Clock::time_point start{Clock::now()};
+			float budget;
+
+		public:
+			FrameBudget(float budget) : budget{ budget } { }
+
+			bool IsExhausted() const
+			{
+				auto elapsedTime(Clock::now() - start);
+				return std::chrono::duration_cast<std::chrono::duration<
+					float, std::milli>>(elapsedTime).count() >= budget;
+			}
+	};
+
+	// A small pool of worker threads. `ParallelFor` splits a range in chunks
+	// which are processed by the workers and by the calling thread, and 
+	// returns once all of them are done. The workers sleep in between.
+	// Every worker takes part in every call, even when the other threads 
+	// already took all the chunks by the time it wakes up: `ParallelFor` 
+	// waits for each of them, so that none can still be in the previous 
+	// call while the next one replaces `task` and `chunkCount`.
+	class WorkerPool
+	{
+		private:
+			std::vector<std::thread> threads;
+			std::mutex mutex;
+			std::condition_variable wakeUp, done;
+
+			std::function<void(std::size_t)> task;
+			std::size_t chunkCount{0};
+			std::atomic<std::size_t> nextChunk{0};
+			std::size_t generation{0}, pendingWorkers{0};
+			bool stopping{false};
+
+			void RunChunks()
+			{
+				for (auto chunk(nextChunk++); chunk < chunkCount; chunk = nextChunk++)
+				{
+					task(chunk);
+				}
+			}
+
+			static std::size_t& CurrentWorkerIndex() noexcept
+			{
+				static thread_local std::size_t index{0};
+				return index;
+			}
+
+			void WorkerLoop(std::size_t index)
+			{
+				CurrentWorkerIndex() = index;
+				std::size_t lastGeneration{0};
+
+				while (true)
+				{
+					{
+						std::unique_lock<std::mutex> lock{ mutex };
+						wakeUp.wait(lock, [&] { return stopping || generation != lastGeneration; });
+
+						if (stopping) return;
+
+						lastGeneration = generation;
+					}
+
+					RunChunks();
+
+					{
+						std::lock_guard<std::mutex> lock{ mutex };
+						--pendingWorkers;
+					}
+
+					done.notify_one();
+				}
+			}
+
+		public:
+			WorkerPool(std::size_t threadCount = std::max(1u, std::thread::hardware_concurrency()) - 1)
+			{
+				for (std::size_t i{0}; i < threadCount; ++i)
+					threads.emplace_back([this, i] { WorkerLoop(i + 1); });
+			}
+
+			~WorkerPool()
+			{
+				{
+					std::lock_guard<std::mutex> lock{ mutex };
+					stopping = true;
+				}
+
+				wakeUp.notify_all();
+
+				for (auto& thread : threads)
+					thread.join();
+			}
+
+			// The calling thread counts as a worker too.
+			std::size_t GetWorkerCount() const noexcept
+			{
+				return threads.size() + 1;
+			}
+
+			// In [0, GetWorkerCount()): 0 is the thread that calls 
+			// `ParallelFor` (and any thread outside of the pool).
+			static std::size_t GetWorkerIndex() noexcept
+			{
+				return CurrentWorkerIndex();
+			}
+
+			// Calls `function(first, last)` on disjoint ranges covering 
+			// [0, count), each at most `grainSize` elements long.
+			template<typename TFunction> 
+			void ParallelFor(std::size_t count, std::size_t grainSize, TFunction&& function)
+			{
+				if (threads.empty() || count <= grainSize)
+				{
+					if (count > 0) function(std::size_t{0}, count);
+					return;
+				}
+
+				{
+					std::lock_guard<std::mutex> lock{ mutex };
+
+					task = [&function, count, grainSize](std::size_t chunk)
+					{
+						auto first(chunk * grainSize);
+						function(first, std::min(count, first + grainSize));
+					};
+
+					chunkCount = (count + grainSize - 1) / grainSize;
+					nextChunk = 0;
+					pendingWorkers = threads.size();
+					++generation;
+				}
+
+				wakeUp.notify_all();
+				RunChunks();
+
+				// A worker only checks in once it ran out of chunks, so when 
+				// all of them did, every chunk is done.
+				std::unique_lock<std::mutex> lock{ mutex };
+				done.wait(lock, [&] { return pendingWorkers == 0; });
+			}
+	};
+
+	// Other threads hand work to the simulation through a bounded ring 
+	// buffer that any number of threads can push to, and only the 
+	// simulation pops from. Nothing in it ever locks: every slot has a 
+	// sequence number that tells whether it's free for the producer that 
+	// claimed it, or ready for the consumer. When the ring is full `TryPush`
+	// fails, and it's up to the producer to retry, so the simulation never
+	// waits on anybody.
+	template<typename T, std::size_t capacity> 
+	class MpscQueue
+	{
+		static_assert(capacity >= 2 && (capacity & (capacity - 1)) == 0, 
+			"MpscQueue capacity must be a power of two");
+
+		private:
+			struct Slot
+			{
+				std::atomic<std::size_t> sequence;
+				T value;
+			};
+
+			std::unique_ptr<Slot[]> slots{new Slot[capacity]};
+
+			// Producers and the consumer each have their own position, on 
+			// their own cache line, so they don't slow each other down.
+			std::atomic<std::size_t> tail{0};
+			char padding[64];
+			std::size_t head{0};
+
+		public:
+			MpscQueue()
+			{
+				for (std::size_t i{0}; i < capacity; ++i)
+					slots[i].sequence.store(i, std::memory_order_relaxed);
+			}
+
+			// Can be called from any thread. Returns false if the queue is full.
+			bool TryPush(const T& value)
+			{
+				auto position(tail.load(std::memory_order_relaxed));
+
+				while (true)
+				{
+					auto& slot(slots[position & (capacity - 1)]);
+					auto sequence(slot.sequence.load(std::memory_order_acquire));
+					auto difference(static_cast<std::ptrdiff_t>(sequence - position));
+
+					if (difference == 0)
+					{
+						// The slot is free: claim it, unless another producer
+						// got there first.
+						if (tail.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+						{
+							slot.value = value;
+							slot.sequence.store(position + 1, std::memory_order_release);
+							return true;
+						}
+					}
+					else if (difference < 0)
+					{
+						return false;
+					}
+					else
+					{
+						position = tail.load(std::memory_order_relaxed);
+					}
+				}
+			}
+
+			// Consumer only. Moves up to `maxCount` values to `output` and 
+			// returns how many there were; stops early at the first slot 
+			// that isn't ready yet.
+			template<typename TOutputIterator> 
+			std::size_t PopBatch(TOutputIterator output, std::size_t maxCount)
+			{
+				std::size_t count{0};
+
+				for (; count < maxCount; ++count, ++head)
+				{
+					auto& slot(slots[head & (capacity - 1)]);
+					if (slot.sequence.load(std::memory_order_acquire) != head + 1) break;
+
+					*output++ = std::move(slot.value);
+					slot.sequence.store(head + capacity, std::memory_order_release);
+				}
+
+				return count;
+			}
+	};
+
+	namespace Internal
+	{
+		// Index of the lowest set bit: a single `tzcnt`/`bsf` instruction.
+		inline unsigned CountTrailingZeros(std::uint64_t value) noexcept
+		{
+			assert(value != 0);
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_ARM64))
+			unsigned long index;
+			_BitScanForward64(&index, value);
+			return static_cast<unsigned>(index);
+#elif defined(_MSC_VER)
+			unsigned long index;
+			if (_BitScanForward(&index, static_cast<unsigned long>(value))) 
+				return static_cast<unsigned>(index);
+			_BitScanForward(&index, static_cast<unsigned long>(value >> 32));
+			return static_cast<unsigned>(index) + 32;
+#else
+			return static_cast<unsigned>(__builtin_ctzll(value));
+#endif
+		}
+	}
+
+	// A set of entity slots, as a two-level bitset: one bit per slot, and 
+	// a summary with one bit per word, set when the word isn't empty. 
+	// Iterating skips a whole summary word (4096 slots) with one test, and
+	// finds the set bits of a word with `CountTrailingZeros`, so sparse 
+	// sets cost next to nothing to scan.
+	class HierarchicalBitset
+	{
+		private:
+			std::vector<std::uint64_t> words, summary;
+
+		public:
+			// Only grows: new slots start cleared.
+			void Resize(std::size_t bitCount)
+			{
+				auto wordCount((bitCount + 63) / 64);
+				if (wordCount <= words.size()) return;
+
+				words.resize(wordCount, 0);
+				summary.resize((wordCount + 63) / 64, 0);
+			}
+
+			void Set(std::size_t bit) noexcept
+			{
+				auto word(bit / 64);
+				words[word] |= std::uint64_t{1} << (bit % 64);
+				summary[word / 64] |= std::uint64_t{1} << (word % 64);
+			}
+
+			void Reset(std::size_t bit) noexcept
+			{
+				auto word(bit / 64);
+				words[word] &= ~(std::uint64_t{1} << (bit % 64));
+				if (words[word] == 0) summary[word / 64] &= ~(std::uint64_t{1} << (word % 64));
+			}
+
+			bool Test(std::size_t bit) const noexcept
+			{
+				return (words[bit / 64] >> (bit % 64)) & 1u;
+			}
+
+			void Clear() noexcept
+			{
+				std::fill(std::begin(words), std::end(words), 0);
+				std::fill(std::begin(summary), std::end(summary), 0);
+			}
+
+			// Calls `function(bit)`, in increasing order, for every bit that
+			// is set in all of `sets`. The sets must have the same size.
+			template<typename TFunction>
+			static void ForEachInAll(std::initializer_list<const HierarchicalBitset*> sets, TFunction function)
+			{
+				auto& first(**std::begin(sets));
+
+				for (std::size_t s{0}; s < first.summary.size(); ++s)
+				{
+					auto summaryWord(first.summary[s]);
+					for (auto set : sets) summaryWord &= set->summary[s];
+
+					while (summaryWord != 0)
+					{
+						auto word(s * 64 + Internal::CountTrailingZeros(summaryWord));
+						summaryWord &= summaryWord - 1;
+
+						auto bits(first.words[word]);
+						for (auto set : sets) bits &= set->words[word];
+
+						while (bits != 0)
+						{
+							function(word * 64 + Internal::CountTrailingZeros(bits));
+							bits &= bits - 1;
+						}
+					}
+				}
+			}
+
+			static std::size_t CountInAll(std::initializer_list<const HierarchicalBitset*> sets)
+			{
+				std::size_t count{0};
+				auto& first(**std::begin(sets));
+
+				for (std::size_t s{0}; s < first.summary.size(); ++s)
+				{
+					auto summaryWord(first.summary[s]);
+					for (auto set : sets) summaryWord &= set->summary[s];
+
+					while (summaryWord != 0)
+					{
+						auto word(s * 64 + Internal::CountTrailingZeros(summaryWord));
+						summaryWord &= summaryWord - 1;
+
+						auto bits(first.words[word]);
+						for (auto set : sets) bits &= set->words[word];
+						count += std::bitset<64>(bits).count();
+					}
+				}
+
+				return count;
+			}
+	};
+
+	// If `Entity` is an aggregate of components, `EntityManager` is an aggregate
+	// of entities. Implementation is straightforward, and resembles the 
+	// previous one.
+	class EntityManager
+	{
+		private:
+			// Declared first, so that it's still valid while entities are
+			// destroyed with the manager.
+			ResourceRegistry* resources{nullptr};
+
+			std::vector<std::unique_ptr<Entity>> entities;
+
+			// Every entity gets a slot, reused after it dies, and the alive
+			// and active flags and the groups of all the entities are 
+			// mirrored in bitsets indexed by slot. Scanning them doesn't 
+			// touch the entities at all.
+			std::vector<Entity*> slots;
+			std::vector<std::uint32_t> freeSlots;
+			HierarchicalBitset aliveSet, activeSet;
+			std::array<HierarchicalBitset, maxGroups> groupSets;
+
+			void AcquireSlot(Entity* entity)
+			{
+				if (freeSlots.empty())
+				{
+					entity->slot = static_cast<std::uint32_t>(slots.size());
+					slots.emplace_back(entity);
+
+					aliveSet.Resize(slots.size());
+					activeSet.Resize(slots.size());
+					for (auto& set : groupSets) set.Resize(slots.size());
+				}
+				else
+				{
+					entity->slot = freeSlots.back();
+					freeSlots.pop_back();
+					slots[entity->slot] = entity;
+				}
+
+				if (entity->alive) aliveSet.Set(entity->slot);
+				if (entity->active) activeSet.Set(entity->slot);
+
+				for (std::size_t i{0}; i < maxGroups; ++i)
+				{
+					if (entity->groupBitset[i]) groupSets[i].Set(entity->slot);
+				}
+			}
+
+			void ReleaseSlot(Entity* entity)
+			{
+				aliveSet.Reset(entity->slot);
+				activeSet.Reset(entity->slot);
+				for (auto& set : groupSets) set.Reset(entity->slot);
+
+				slots[entity->slot] = nullptr;
+				freeSlots.emplace_back(entity->slot);
+			}
+
+			// Entities are also bucketed by archetype, for queries on the
+			// components they have. Buckets are indexed by `ArchetypeID`.
+			std::vector<std::vector<Entity*>> archetypes;
+
+			void InsertInArchetype(Entity* entity, ArchetypeID archetype)
+			{
+				if (archetype >= archetypes.size()) archetypes.resize(archetype + 1);
+
+				auto& bucket(archetypes[archetype]);
+				entity->archetype = archetype;
+				entity->archetypeRow = static_cast<std::uint32_t>(bucket.size());
+				bucket.emplace_back(entity);
+			}
+
+			// Swap and pop: the last entity of the bucket takes the row.
+			void RemoveFromArchetype(Entity* entity)
+			{
+				auto& bucket(archetypes[entity->archetype]);
+				auto row(entity->archetypeRow);
+
+				bucket[row] = bucket.back();
+				bucket[row]->archetypeRow = row;
+				bucket.pop_back();
+			}
+
+			void MoveToArchetype(Entity* entity, ArchetypeID archetype)
+			{
+				RemoveFromArchetype(entity);
+				InsertInArchetype(entity, archetype);
+			}
+
+			void MoveArchetype(ArchetypeID from, ArchetypeID to)
+			{
+				if (to >= archetypes.size()) archetypes.resize(to + 1);
+
+				auto& source(archetypes[from]);
+				auto& destination(archetypes[to]);
+				auto firstRow(static_cast<std::uint32_t>(destination.size()));
+
+				destination.insert(std::end(destination), std::begin(source), std::end(source));
+				for (std::uint32_t i{0}; i < source.size(); ++i)
+				{
+					source[i]->archetype = to;
+					source[i]->archetypeRow = firstRow + i;
+				}
+
+				source.clear();
+			}
+
+			// Moves every entity of `entities` along the `id` edge of its
+			// archetype. Each edge is looked up once per source archetype, 
+			// and a source bucket that moves entirely is moved as a whole.
+			// Sources and destinations can't overlap: an entity either has
+			// `id` or it doesn't.
+			void TransitionAll(const std::vector<Entity*>& entities, ComponentID id, bool adding)
+			{
+				std::vector<ArchetypeID> sources;
+				sources.reserve(entities.size());
+
+				std::vector<std::size_t> counts(archetypes.size(), 0);
+				for (auto e : entities)
+				{
+					sources.emplace_back(e->archetype);
+					++counts[e->archetype];
+				}
+
+				std::vector<ArchetypeID> destinations(archetypes.size(), noArchetype);
+				for (ArchetypeID from{0}; from < counts.size(); ++from)
+				{
+					if (counts[from] == 0) continue;
+
+					destinations[from] = adding 
+						? ArchetypeGraph::GetAddTransition(from, id) 
+						: ArchetypeGraph::GetRemoveTransition(from, id);
+
+					if (counts[from] == archetypes[from].size())
+					{
+						MoveArchetype(from, destinations[from]);
+						counts[from] = 0;
+					}
+				}
+
+				for (std::size_t i{0}; i < entities.size(); ++i)
+				{
+					if (counts[sources[i]] != 0) 
+						MoveToArchetype(entities[i], destinations[sources[i]]);
+				}
+			}
+
+			// We store entities in groups by creating "group buckets" in an 
+			// array. `std::vector<Entity*>` could be also replaced for 
+			// `std::set<Entity*>`.
+			std::array<std::vector<Entity*>, maxGroups> groupedEntities;
+
+			// Dead entities are not freed during `Refresh`: they are moved
+			// here and released a few at a time by `CollectGarbage`, so that
+			// destroying a big wave doesn't cause a frame spike.
+			std::vector<std::unique_ptr<Entity>> graveyard;
+
+			std::uint64_t createdEntityCount{0};
+
+			// The block of IDs this manager hands out.
+			EntityID nextID{0}, lastID{0};
+
+			// Structural changes that observers are interested in are
+			// queued while the tick runs, and delivered in batches on
+			// refresh: all the entities that got the same component (or
+			// joined the same group) are handed over in a single call.
+			enum class Notification : std::uint8_t
+			{
+				ComponentAdded,
+				GroupJoined,
+				ComponentRemoved,
+				GroupLeft,
+				Count
+			};
+
+			struct PendingNotification
+			{
+				Notification notification;
+				std::uint8_t id; // Component or group
+				Entity* entity;
+			};
+
+			static_assert(maxComponents == maxGroups, 
+				"Observers are indexed by component or group ID");
+
+			std::array<std::array<std::vector<Observer>, maxComponents>, 
+				static_cast<std::size_t>(Notification::Count)> observers;
+			std::vector<PendingNotification> pendingNotifications;
+
+			std::vector<Observer>& GetObservers(Notification notification, std::size_t id)
+			{
+				return observers[static_cast<std::size_t>(notification)][id];
+			}
+
+			// Nothing is queued when nobody is listening.
+			void Notify(Notification notification, std::size_t id, Entity* entity)
+			{
+				if (GetObservers(notification, id).empty()) return;
+
+				pendingNotifications.emplace_back(PendingNotification{ 
+					notification, static_cast<std::uint8_t>(id), entity });
+			}
+
+			void NotifyAll(Notification componentNotification, Notification groupNotification, Entity* entity);
+
+			// Notifications are sorted by kind and type, and every run of
+			// them becomes a batch. The sort is stable, so a batch lists 
+			// entities in the order the changes happened. Dead entities 
+			// are still in the graveyard at this point, so the pointers 
+			// in a batch are always valid.
+			void DeliverNotifications()
+			{
+				if (pendingNotifications.empty()) return;
+
+				// Observers may change the world, too: their changes are
+				// delivered at the next refresh.
+				auto notifications(std::move(pendingNotifications));
+				pendingNotifications.clear();
+
+				std::stable_sort(std::begin(notifications), std::end(notifications), 
+					[](const PendingNotification& a, const PendingNotification& b)
+					{
+						return std::tie(a.notification, a.id) < std::tie(b.notification, b.id);
+					});
+
+				std::vector<Entity*> batch;
+				for (auto first(std::begin(notifications)); first != std::end(notifications);)
+				{
+					auto last(std::find_if(first, std::end(notifications), 
+						[first](const PendingNotification& n)
+						{
+							return n.notification != first->notification || n.id != first->id;
+						}));
+
+					batch.clear();
+					for (auto i(first); i != last; ++i)
+						batch.emplace_back(i->entity);
+
+					for (auto& observer : GetObservers(first->notification, first->id))
+						observer(batch);
+
+					first = last;
+				}
+			}
+
+		public:
+			// Observers can be registered for components being added to or
+			// removed from entities, and for entities joining or leaving a
+			// group. Components are only removed when their entity dies.
+			template<typename T> void OnAdd(Observer observer)
+			{
+				GetObservers(Notification::ComponentAdded, GetComponentTypeID<T>()).emplace_back(std::move(observer));
+			}
+
+			template<typename T> void OnRemove(Observer observer)
+			{
+				GetObservers(Notification::ComponentRemoved, GetComponentTypeID<T>()).emplace_back(std::move(observer));
+			}
+
+			void OnGroupJoin(Group group, Observer observer)
+			{
+				GetObservers(Notification::GroupJoined, group).emplace_back(std::move(observer));
+			}
+
+			void OnGroupLeave(Group group, Observer observer)
+			{
+				GetObservers(Notification::GroupLeft, group).emplace_back(std::move(observer));
+			}
+
+			// Managers of the same world share its registry.
+			void SetResources(ResourceRegistry& registry) noexcept
+			{
+				resources = &registry;
+			}
+
+			ResourceRegistry& GetResources() const noexcept
+			{
+				assert(resources != nullptr);
+				return *resources;
+			}
+
+			// Entities follow the archetype graph as components come and go.
+			void ComponentAdded(Entity* entity, ComponentID id)
+			{
+				MoveToArchetype(entity, ArchetypeGraph::GetAddTransition(entity->archetype, id));
+				Notify(Notification::ComponentAdded, id, entity);
+			}
+
+			void ComponentRemoved(Entity* entity, ComponentID id)
+			{
+				MoveToArchetype(entity, ArchetypeGraph::GetRemoveTransition(entity->archetype, id));
+				Notify(Notification::ComponentRemoved, id, entity);
+			}
+
+			// Calls `function` on every alive entity that has all the 
+			// components `Ts`, looking only at the matching archetypes. 
+			// `function` must not add or remove components.
+			template<typename... Ts, typename TFunction> void ForEachWith(TFunction function) const
+			{
+				ComponentBitset mask;
+				using Expand = int[];
+				(void)Expand{ 0, (mask[GetComponentTypeID<Ts>()] = true, 0)... };
+
+				for (ArchetypeID a{0}; a < archetypes.size(); ++a)
+				{
+					if (archetypes[a].empty() || (ArchetypeGraph::GetSignature(a) & mask) != mask) 
+						continue;
+
+					for (auto e : archetypes[a])
+					{
+						if (e->IsAlive()) function(*e);
+					}
+				}
+			}
+
+			// Calls `function(signature, entities)` for every archetype that
+			// has entities. Dead entities are included.
+			template<typename TFunction> void ForEachArchetype(TFunction function) const
+			{
+				for (ArchetypeID a{0}; a < archetypes.size(); ++a)
+				{
+					if (!archetypes[a].empty()) function(ArchetypeGraph::GetSignature(a), archetypes[a]);
+				}
+			}
+
+			void Update(float frameTime) 	
+			{ 
+				for (auto& e : entities)
+				{
+					if (e->IsActive())
+					{
+						e->Update(frameTime);
+					}
+				}
+			}
+
+			void Draw() 			
+			{ 
+				for (auto& e : entities)
+				{
+					if (e->IsActive())
+					{
+						e->Draw();
+					}
+				}
+			}
+
+			// When we add a group to an entity, we just add it to the
+			// correct "group bucket".
+			void AddToGroup(Entity* entity, Group group)
+			{
+				// An entity that left the group and joined it again before
+				// the refresh is still in the bucket: it must not be added 
+				// twice.
+				if (entity->bucketBitset[group]) return;
+
+				entity->bucketBitset[group] = true;
+				groupedEntities[group].emplace_back(entity);
+				Notify(Notification::GroupJoined, group, entity);
+			}
+
+			// To get entities that belong to a certain group, we can simply
+			// get one of the "buckets" from the array.
+			std::vector<Entity*>& GetEntitiesByGroup(Group group)
+			{
+				return groupedEntities[group];
+			}
+
+			// Keep the bitsets in sync with the flags of the entities.
+			void SetAlive(Entity* entity, bool alive) noexcept
+			{
+				if (alive) aliveSet.Set(entity->slot); else aliveSet.Reset(entity->slot);
+			}
+
+			void SetActive(Entity* entity, bool active) noexcept
+			{
+				if (active) activeSet.Set(entity->slot); else activeSet.Reset(entity->slot);
+			}
+
+			void SetInGroup(Entity* entity, Group group, bool member) noexcept
+			{
+				if (member) groupSets[group].Set(entity->slot); else groupSets[group].Reset(entity->slot);
+			}
+
+			// Calls `function(entity)` for every alive and active entity of
+			// `group`, in slot order. Unlike the group bucket, this is 
+			// always up to date, and inactive entities aren't even loaded.
+			template<typename TFunction> void ForEachActiveInGroup(Group group, TFunction function) const
+			{
+				HierarchicalBitset::ForEachInAll({ &aliveSet, &activeSet, &groupSets[group] }, 
+					[&](std::size_t slot) { function(*slots[slot]); });
+			}
+
+			std::size_t CountActiveInGroup(Group group) const
+			{
+				return HierarchicalBitset::CountInAll({ &aliveSet, &activeSet, &groupSets[group] });
+			}
+
+			// During refresh, we need to remove dead entities and entities
+			// with incorrect groups from the buckets.
+			void Refresh()
+			{
+				for(auto i(0u); i < maxGroups; ++i)
+				{
+					auto& v(groupedEntities[i]);
+
+					v.erase(
+						std::remove_if(std::begin(v), std::end(v), 
+						[this, i](Entity* entity) 
+						{ 
+							if (entity->IsAlive() && entity->HasGroup(i)) return false;
+
+							entity->bucketBitset[i] = false;
+							Notify(Notification::GroupLeft, i, entity);
+							return true;
+						}), 
+						std::end(v));
+				}
+
+				// Moving "dead" entities to the graveyard.
+				auto firstDead(std::begin(entities));
+				for (auto& entity : entities)
+				{
+					if (!entity->IsAlive())
+					{
+						NotifyAll(Notification::ComponentRemoved, Notification::Count, entity.get());
+						RemoveFromArchetype(entity.get());
+						ReleaseSlot(entity.get());
+						graveyard.emplace_back(std::move(entity));
+						continue;
+					}
+
+					if (&*firstDead != &entity)
+						*firstDead = std::move(entity);
+
+					++firstDead;
+				}
+
+				entities.erase(firstDead, std::end(entities));
+
+				DeliverNotifications();
+			}
+
+			// Frees dead entities until the budget runs out.
+			void CollectGarbage(const FrameBudget& budget)
+			{
+				while (!graveyard.empty() && !budget.IsExhausted())
+				{
+					graveyard.pop_back();
+				}
+			}
+
+			Entity& AddEntity()
+			{				
+				++createdEntityCount;
+
+				if (nextID == lastID)
+				{
+					nextID = EntityIDAllocator::Reserve(entityIDBlockSize);
+					lastID = nextID + entityIDBlockSize;
+				}
+
+				Entity* e(new Entity(*this));
+				e->id = nextID++;
+				std::unique_ptr<Entity> uPtr{e};
+				entities.emplace_back(std::move(uPtr));
+				InsertInArchetype(e, emptyArchetype);
+				AcquireSlot(e);
+				return *e;
+			}	
+
+			void Reserve(std::size_t count)
+			{
+				entities.reserve(count);
+			}
+
+			// The next `count` entities get consecutive IDs from a block
+			// reserved now, rather than when the current block runs out.
+			void ReserveIDs(std::size_t count) noexcept
+			{
+				nextID = EntityIDAllocator::Reserve(count);
+				lastID = nextID + count;
+			}
+
+			std::size_t GetEntityCount() const noexcept
+			{
+				return entities.size();
+			}
+
+			std::size_t GetGraveyardCount() const noexcept
+			{
+				return graveyard.size();
+			}
+
+			// Total number of entities ever created by this manager.
+			std::uint64_t GetCreatedEntityCount() const noexcept
+			{
+				return createdEntityCount;
+			}
+
+			// Moves all the entities (and their groups) of `other` into this
+			// manager with a single bulk operation. This is how entities that 
+			// were prepared ahead of time get activated.
+			// Adopted entities are announced to the observers of this 
+			// manager as if their components and groups were just added.
+			void Adopt(EntityManager& other)
+			{
+				// Components look their resources up through their manager:
+				// adopted entities must find the same ones.
+				assert(other.resources == resources);
+
+				for (auto& e : other.entities)
+				{
+					e->manager = this;
+					AcquireSlot(e.get());
+					NotifyAll(Notification::ComponentAdded, Notification::GroupJoined, e.get());
+				}
+
+				// Only dead entities are left in `other`, and their slots
+				// were released on refresh.
+				other.slots.clear();
+				other.freeSlots.clear();
+				other.aliveSet.Clear();
+				other.activeSet.Clear();
+				for (auto& set : other.groupSets) set.Clear();
+
+				entities.reserve(entities.size() + other.entities.size());
+				std::move(std::begin(other.entities), std::end(other.entities),
+					std::back_inserter(entities));
+				other.entities.clear();
+
+				for (auto i(0u); i < maxGroups; ++i)
+				{
+					auto& source(other.groupedEntities[i]);
+					auto& destination(groupedEntities[i]);
+
+					destination.insert(std::end(destination), 
+						std::begin(source), std::end(source));
+					source.clear();
+				}
+
+				// Archetype IDs are the same in both managers, so buckets
+				// are appended as a whole. Only the rows need fixing.
+				if (other.archetypes.size() > archetypes.size()) 
+					archetypes.resize(other.archetypes.size());
+
+				for (std::size_t a{0}; a < other.archetypes.size(); ++a)
+				{
+					auto& source(other.archetypes[a]);
+					auto& destination(archetypes[a]);
+					auto firstRow(static_cast<std::uint32_t>(destination.size()));
+
+					destination.insert(std::end(destination), std::begin(source), std::end(source));
+					for (std::uint32_t i{0}; i < source.size(); ++i)
+						source[i]->archetypeRow = firstRow + i;
+
+					source.clear();
+				}
+			}
+
+			// Entities having all the components `Ts`.
+			template<typename... Ts> std::vector<Entity*> GetEntitiesWith() const
+			{
+				std::vector<Entity*> result;
+				ForEachWith<Ts...>([&result](Entity& entity) { result.emplace_back(&entity); });
+				return result;
+			}
+
+			// Batched versions of the structural operations of `Entity`.
+			// They take any span of entities of this manager (a group 
+			// bucket, the result of a query...) and do the bookkeeping 
+			// once per batch instead of once per entity.
+			void AddGroup(const std::vector<Entity*>& entities, Group group)
+			{
+				auto& bucket(groupedEntities[group]);
+
+				// The bucket of `group` can only contain entities that
+				// were removed from it since the last refresh.
+				if (&entities == &bucket)
+				{
+					for (auto e : entities) 
+					{
+						e->groupBitset[group] = true;
+						groupSets[group].Set(e->slot);
+					}
+					return;
+				}
+
+				bucket.reserve(bucket.size() + entities.size());
+				auto observed(!GetObservers(Notification::GroupJoined, group).empty());
+
+				for (auto e : entities)
+				{
+					if (e->groupBitset[group]) continue;
+
+					e->groupBitset[group] = true;
+					groupSets[group].Set(e->slot);
+
+					// Same as `AddToGroup`: entities still in the bucket
+					// aren't added twice.
+					if (e->bucketBitset[group]) continue;
+
+					e->bucketBitset[group] = true;
+					bucket.emplace_back(e);
+
+					if (observed) 
+						pendingNotifications.emplace_back(PendingNotification{ 
+							Notification::GroupJoined, static_cast<std::uint8_t>(group), e });
+				}
+			}
+
+			// Like `Entity::DelGroup`, buckets are cleaned up on refresh.
+			void DelGroup(const std::vector<Entity*>& entities, Group group) noexcept
+			{
+				for (auto e : entities) 
+				{
+					e->groupBitset[group] = false;
+					groupSets[group].Reset(e->slot);
+				}
+			}
+
+			void Enable(const std::vector<Entity*>& entities) noexcept
+			{
+				for (auto e : entities) 
+				{
+					e->active = true;
+					activeSet.Set(e->slot);
+				}
+			}
+
+			void Disable(const std::vector<Entity*>& entities) noexcept
+			{
+				for (auto e : entities) 
+				{
+					e->active = false;
+					activeSet.Reset(e->slot);
+				}
+			}
+
+			void Destroy(const std::vector<Entity*>& entities) noexcept
+			{
+				for (auto e : entities) 
+				{
+					e->alive = false;
+					aliveSet.Reset(e->slot);
+				}
+			}
+
+			// Every entity gets its own component, constructed from the 
+			// same arguments.
+			template<typename T, typename... TArgs> 
+			void AddComponent(const std::vector<Entity*>& entities, const TArgs&... args)
+			{
+				auto id(GetComponentTypeID<T>());
+
+				for (auto e : entities)
+				{
+					assert(!e->HasComponent<T>());
+
+					T* c(new T(args...));
+					c->entity = e;
+					e->components.emplace_back(std::unique_ptr<Component>{c});
+					e->componentArray[id] = c;
+					e->componentBitset[id] = true;
+					c->Initialize();
+				}
+
+				TransitionAll(entities, id, true);
+
+				if (GetObservers(Notification::ComponentAdded, id).empty()) return;
+				for (auto e : entities) Notify(Notification::ComponentAdded, id, e);
+			}
+
+			template<typename T> void RemoveComponent(const std::vector<Entity*>& entities)
+			{
+				auto id(GetComponentTypeID<T>());
+
+				for (auto e : entities)
+				{
+					assert(e->HasComponent<T>());
+
+					auto c(e->componentArray[id]);
+					e->components.erase(std::find_if(std::begin(e->components), std::end(e->components),
+						[c](const std::unique_ptr<Component>& component) { return component.get() == c; }));
+					e->componentArray[id] = nullptr;
+					e->componentBitset[id] = false;
+				}
+
+				TransitionAll(entities, id, false);
+
+				if (GetObservers(Notification::ComponentRemoved, id).empty()) return;
+				for (auto e : entities) Notify(Notification::ComponentRemoved, id, e);
+			}
+	};
+
+	// Here's the definition of `Entity::addToGroup`
+	void Entity::AddGroup(Group group) noexcept
+	{
+		groupBitset[group] = true;
+		manager->SetInGroup(this, group, true);
+		manager->AddToGroup(this, group);
+	}
+
+	void Entity::DelGroup(Group group) noexcept
+	{
+		groupBitset[group] = false;
+		manager->SetInGroup(this, group, false);
+	}
+
+	void Entity::Destroy() noexcept
+	{
+		alive = false;
+		manager->SetAlive(this, false);
+	}
+
+	void Entity::Enable() noexcept
+	{
+		active = true;
+		manager->SetActive(this, true);
+	}
+
+	void Entity::Disable() noexcept
+	{
+		active = false;
+		manager->SetActive(this, false);
+	}
+
+	void Entity::NotifyComponentAdded(ComponentID id)
+	{
+		manager->ComponentAdded(this, id);
+	}
+
+	void Entity::NotifyComponentRemoved(ComponentID id)
+	{
+		manager->ComponentRemoved(this, id);
+	}
+
+	template<typename T> T& Entity::GetResource() const
+	{
+		return manager->GetResources().Get<T>();
+	}
+
+	// Lets the worker pool create entities. Every chunk of the work is 
+	// built in its own staging manager, so creation needs no locking, and
+	// `Publish` adopts them all once the workers are done. The IDs of 
+	// every chunk are reserved up front, on the calling thread, so the 
+	// result is the same whichever worker built which chunk. Components
+	// added from a worker must only touch resources that are safe to use
+	// concurrently.
+	class ConcurrentSpawner
+	{
+		private:
+			ResourceRegistry& resources;
+			std::vector<std::unique_ptr<EntityManager>> stagings;
+
+		public:
+			ConcurrentSpawner(ResourceRegistry& resources) : resources(resources) { }
+
+			// Calls `function(staging, i)` for every `i` in [0, count), on the
+			// workers, `grainSize` at a time. Each call should create one 
+			// entity in `staging`.
+			template<typename TFunction> 
+			void Spawn(WorkerPool& workers, std::size_t count, std::size_t grainSize, TFunction function)
+			{
+				auto chunkCount((count + grainSize - 1) / grainSize);
+
+				while (stagings.size() < chunkCount)
+				{
+					stagings.emplace_back(std::make_unique<EntityManager>());
+					stagings.back()->SetResources(resources);
+				}
+
+				for (std::size_t chunk{0}; chunk < chunkCount; ++chunk)
+					stagings[chunk]->ReserveIDs(std::min(grainSize, count - chunk * grainSize));
+
+				workers.ParallelFor(count, grainSize, [&](std::size_t first, std::size_t last)
+				{
+					for (auto i(first); i < last; ++i) function(*stagings[i / grainSize], i);
+				});
+			}
+
+			// Chunks are published in order, so entities end up in `target`
+			// in the order of their index.
+			void Publish(EntityManager& target)
+			{
+				for (auto& staging : stagings)
+				{
+					if (staging->GetEntityCount() > 0) target.Adopt(*staging);
+				}
+			}
+
+			std::uint64_t GetCreatedEntityCount() const noexcept
+			{
+				std::uint64_t count{0};
+				for (auto& staging : stagings) count += staging->GetCreatedEntityCount();
+				return count;
+			}
+	};
+
+	// Systems can also be written as per-entity kernels, which declare the
+	// components they use:
+	//
+	//     struct Movement
+	//     {
+	//         using Reads = Components<Physics>;
+	//         using Writes = Components<Transform>;
+	//         using Gathers = Components<>;
+	//
+	//         void operator()(Entity& entity, FrameTime frameTime);
+	//     };
+	//
+	// `Gathers` lists the components a kernel reads from *other* entities.
+	// A kernel runs on every active entity that has all the components it
+	// reads and writes, and must not add or remove components.
+	template<typename... Ts> struct Components { };
+
+	// The compile-time helpers below stick to C++11 `constexpr` (a single
+	// return statement, recursion instead of loops), which is all Visual 
+	// Studio 2015 supports.
+	namespace Internal
+	{
+		constexpr bool AnyOf() noexcept { return false; }
+
+		template<typename... TBools> constexpr bool AnyOf(bool first, TBools... rest) noexcept
+		{
+			return first || AnyOf(rest...);
+		}
+
+		template<typename T, typename... Ts> constexpr bool Contains(Components<Ts...>) noexcept
+		{
+			return AnyOf(std::is_same<T, Ts>::value...);
+		}
+
+		template<typename... Ts, typename TList> constexpr bool Overlaps(Components<Ts...>, TList) noexcept
+		{
+			return AnyOf(Contains<Ts>(TList{})...);
+		}
+
+		template<typename... Ts> ComponentBitset GetComponentMask(Components<Ts...>)
+		{
+			ComponentBitset mask;
+			using Expand = int[];
+			(void)Expand{ 0, (mask[GetComponentTypeID<Ts>()] = true, 0)... };
+			return mask;
+		}
+
+		// Running `TFirst` on all the entities and then `TSecond` gives the
+		// same result as running both on each entity in turn, unless one of
+		// them reads from other entities what the other one writes.
+		template<typename TFirst, typename TSecond> constexpr bool Conflicts() noexcept
+		{
+			return Overlaps(typename TFirst::Writes{}, typename TSecond::Gathers{})
+				|| Overlaps(typename TFirst::Gathers{}, typename TSecond::Writes{});
+		}
+	}
+
+	// A `SystemChain` runs its kernels as if one after the other, but 
+	// consecutive kernels that don't conflict are fused in a single pass
+	// over the entities: each entity is loaded once, and every kernel of 
+	// the pass runs on it in turn. Which kernels are fused is worked out
+	// at compile time; which of them apply to an archetype is worked out 
+	// once per archetype.
+	template<typename... TKernels> class SystemChain
+	{
+		private:
+			static constexpr std::size_t kernelCount{sizeof...(TKernels)};
+			static_assert(kernelCount <= 32, "A SystemChain can have at most 32 kernels");
+
+			template<std::size_t I> using KernelAt = std::tuple_element_t<I, std::tuple<TKernels...>>;
+
+			// The pairs of kernels are numbered `first * kernelCount + second`.
+			template<std::size_t... Is> 
+			static constexpr bool ConflictsAt(std::size_t pair, std::index_sequence<Is...>) noexcept
+			{
+				return Internal::AnyOf((Is == pair 
+					&& Internal::Conflicts<KernelAt<Is / kernelCount>, KernelAt<Is % kernelCount>>())...);
+			}
+
+			// Does `kernel` conflict with any of the kernels from `first` to 
+			// the one before it?
+			static constexpr bool ConflictsWithRange(std::size_t first, std::size_t kernel) noexcept
+			{
+				return first < kernel 
+					&& (ConflictsAt(first * kernelCount + kernel, std::make_index_sequence<kernelCount * kernelCount>{})
+						|| ConflictsWithRange(first + 1, kernel));
+			}
+
+			// A kernel joins the current pass if it doesn't conflict with
+			// any kernel already in it, otherwise it starts a new one.
+			static constexpr std::size_t GetPassStart(std::size_t kernel) noexcept
+			{
+				return kernel == 0 ? 0 : JoinOrStartPass(GetPassStart(kernel - 1), kernel);
+			}
+
+			static constexpr std::size_t JoinOrStartPass(std::size_t passStart, std::size_t kernel) noexcept
+			{
+				return ConflictsWithRange(passStart, kernel) ? kernel : passStart;
+			}
+
+			static constexpr std::size_t CountPasses(std::size_t kernel) noexcept
+			{
+				return kernel == kernelCount ? 0 
+					: (GetPassStart(kernel) == kernel ? 1 : 0) + CountPasses(kernel + 1);
+			}
+
+			std::tuple<TKernels...> kernels;
+			std::array<ComponentBitset, kernelCount> masks;
+
+#ifdef SPACE_INVADERS_VALIDATE_ACCESS
+			std::array<ComponentBitset, kernelCount> readMasks{ { (Internal::GetComponentMask(typename TKernels::Reads{}) 
+				| Internal::GetComponentMask(typename TKernels::Gathers{}))... } };
+			std::array<ComponentBitset, kernelCount> writeMasks{ { Internal::GetComponentMask(typename TKernels::Writes{})... } };
+#endif
+
+			template<std::size_t I> void RunKernel(Entity& entity, float frameTime)
+			{
+#ifdef SPACE_INVADERS_VALIDATE_ACCESS
+				AccessValidator::Scope scope{ typeid(KernelAt<I>).name(), readMasks[I], writeMasks[I] };
+#endif
+				std::get<I>(kernels)(entity, frameTime);
+			}
+
+			template<std::size_t... Is>
+			void RunPass(const EntityManager& manager, std::size_t first, std::size_t last, 
+				float frameTime, std::index_sequence<Is...>)
+			{
+				manager.ForEachArchetype([&](const ComponentBitset& signature, const std::vector<Entity*>& entities)
+				{
+					unsigned applicable{0};
+					for (auto k(first); k < last; ++k)
+					{
+						if ((signature & masks[k]) == masks[k]) applicable |= 1u << k;
+					}
+
+					if (applicable == 0) return;
+
+					for (auto e : entities)
+					{
+						if (!e->IsAlive() || !e->IsActive()) continue;
+
+						using Expand = int[];
+						(void)Expand{ 0, ((applicable & (1u << Is)) != 0 
+							? (RunKernel<Is>(*e, frameTime), 0) : 0)... };
+					}
+				});
+			}
+
+		public:
+			SystemChain(TKernels... kernels) : kernels{ kernels... }, 
+				masks{ { (Internal::GetComponentMask(typename TKernels::Reads{}) 
+					| Internal::GetComponentMask(typename TKernels::Writes{}))... } } { }
+
+			static constexpr std::size_t GetPassCount() noexcept
+			{
+				return CountPasses(0);
+			}
+
+			void Run(const EntityManager& manager, float frameTime)
+			{
+				for (std::size_t first{0}; first < kernelCount;)
+				{
+					auto last(first + 1);
+					while (last < kernelCount && GetPassStart(last) == first) ++last;
+
+					RunPass(manager, first, last, frameTime, std::index_sequence_for<TKernels...>{});
+					first = last;
+				}
+			}
+	};
+
+	// Queues a notification for every component and every group of 
+	// `entity`. Passing `Notification::Count` skips groups.
+	void EntityManager::NotifyAll(Notification componentNotification, Notification groupNotification, Entity* entity)
+	{
+		for (std::size_t i{0}; i < maxComponents; ++i)
+		{
+			if (entity->componentBitset[i]) Notify(componentNotification, i, entity);
+		}
+
+		if (groupNotification == Notification::Count) return;
+
+		for (std::size_t i{0}; i < maxGroups; ++i)
+		{
+			if (entity->groupBitset[i]) Notify(groupNotification, i, entity);
+		}
+	}
+
+	//
+	// Let's create the components for our Space Invaders clone
+	//
+	using FrameTime = float;
+
+	const int windowWidth{800}, windowHeight{600};
+	const float playerShipWidth{66.f}, playerShipHeight{50.f}, playerShipVelocity{0.6f};
+	const float enemyShipWidth{ 69.3f }, enemyShipHeight{ 56.f }, enemyShipVelocity{ 0.05f };
+	const float	bulletWidth{ 9.f }, bulletHeight{ 37.f }, bulletVelocity{ 0.5f };
+	const float enemyShipFrameDuration{ 500.f };
+	const int maxPlayerBullets{ 6 }, maxEnemyBullets{ 36 };
+	const std::size_t enemyFireDelayBatch{ 8 }; // Fire delays drawn at once by each enemy ship
+	const float ftStep{1.f}, ftSlice{1.f};
+	const std::uint64_t randomSeed{ 0x5EED5EEDu };
+	const float spawnBudget{ 1.f }; // In milliseconds per frame
+	const std::size_t enemyShipsPerBuildJob{ 4 }, enemyShipsPerBuildBatch{ 32 };
+	const std::size_t bulletsPerCollisionJob{ 16 };
+	const float collisionPrefilterMargin{ 1.f };
+
+	// The world can be bigger than the window. It's split in square cells,
+	// and only the cells within `worldActiveRadius` of the player are kept 
+	// in memory and simulated. By default the world goes on for two more
+	// windows to the right of the first screen, and the view scrolls as 
+	// the player flies there: cells are loaded and unloaded on the way.
+	const float worldWidth{ 3.f * windowWidth }, worldHeight{ windowHeight };
+	const float worldCellSize{ 400.f }, worldActiveRadius{ 400.f };
+	const int worldGenerationDensity{ 2 }; // Ships generated in a never visited cell, out of sight
+	const std::size_t worldLoadQueueCapacity{ 1024 }; // Records in flight from the loaders
+	const char* const worldCellFilePrefix{ "data/world-cell-" };
+	const std::size_t maxParticles{ 1u << 20 };
+	const float particleSize{ 3.f };
+	const int explosionParticles{ 64 };
+	const float explosionSpeed{ 0.15f }, explosionLifetime{ 600.f };
+	// Frame pacing: with `precisePacing` disabled, SFML's own frame limiter
+	// is used instead.
+	const bool precisePacing{ true }, dropLateFrames{ false };
+	// Sprites are drawn between their last two simulated positions,
+	// according to the time left over in `currentSlice`.
+	const bool interpolateRendering{ true };
+	const float targetFramePeriod{ 1000.f / 240.f }, pacingSpinMargin{ 2.f };
+
+	const char* const statsSegmentName{ "space-invaders-stats" };
+	const char* const worldSegmentName{ "space-invaders-world" };
+	const std::size_t inspectorSlotCount{ 1u << 16 }; // Per inspected type
+
+	// Sessions are recorded to `replayFilename`, with a full snapshot of
+	// the world every `replayKeyframeInterval` ticks.
+	const bool recordReplays{ true };
+	const char* const replayFilename{ "replay.sirp" };
+	const std::uint32_t replayKeyframeInterval{ 1000 };
+	const std::size_t replayQueueCapacity{ 8 }; // In chunks
+	const std::size_t replayBacklogCapacity{ 64 }; // In chunks, kept aside by the simulation
+
+	// Reports printed when the game exits are also saved to this file, as
+	// Windows builds have no console.
+	const char* const reportFilename{ "report.txt" };
+
+	const std::size_t hudRunLength{ 16 };
+	const float hudScale{ 2.f };
+	const FrameTime hudPerfRefreshPeriod{ 250.f };
+	const int offensiveEnemyShipScore{ 20 }, defensiveEnemyShipScore{ 10 };
+	const std::size_t inputQueueCapacity{ 256 }; // Input changes in flight from the sampler
+	const float inputSamplePeriod{ 1.f }; // In milliseconds
+	const float thrusterParticlesPerMs{ 0.2f }, thrusterSpeed{ 0.1f }, thrusterSpread{ 0.02f }, thrusterLifetime{ 250.f };
+
+	// Forward declaration
+	struct Game;
+
+	// Entities can have a position in the game world. `Transform` also 
+	// keeps `previousPosition`, where the entity was at the end of the 
+	// last tick, so that rendering can interpolate between the two. It is
+	// only meant for that: the simulation pass updates it entity by 
+	// entity, so it isn't a stable copy other systems could read from 
+	// other threads during the tick. Gameplay systems read `position`.
+	struct Transform : Component
+	{
+		Vec2 position, previousPosition;
+
+		Transform() = default;
+		Transform(const Vec2& position) : position{ position }, previousPosition{ position } { }
+
+		// Called at the start of every tick.
+		void SwapBuffers() noexcept
+		{
+			previousPosition = position;
+		}
+
+		// Moves the entity without interpolating from where it was.
+		void Teleport(const Vec2& target) noexcept
+		{
+			position = previousPosition = target;
+		}
+
+		sf::Vector2f GetInterpolatedPosition(float alpha) const noexcept
+		{
+			sf::Vector2f previous(previousPosition);
+			return previous + (sf::Vector2f(position) - previous) * alpha;
+		}
+
+		Scalar x() const noexcept { return position.x; }
+		Scalar y() const noexcept { return position.y; }
+
+		static void* operator new(std::size_t size) 
+		{ 
+			return WorldInspector::Allocate(InspectedType::Transform, size); 
+		}
+
+		static void operator delete(void* pointer) 
+		{ 
+			WorldInspector::Deallocate(InspectedType::Transform, pointer); 
+		}
+	};
+
+	// Entities can have a physical body and a velocity.
+	struct Physics : Component
+	{
+		Transform* transform{nullptr};
+		Vec2 velocity, halfSize;
+
+		// We will use a callback to handle the "out of bounds" event.
+		std::function<void(const sf::Vector2f&)> onOutOfBounds;
+
+		Physics(const Vec2& halfSize) : halfSize{ halfSize } { }
+
+		static void* operator new(std::size_t size) 
+		{ 
+			return WorldInspector::Allocate(InspectedType::Physics, size); 
+		}
+
+		static void operator delete(void* pointer) 
+		{ 
+			WorldInspector::Deallocate(InspectedType::Physics, pointer); 
+		}
+
+		void Initialize() override
+		{	
+			// A requirement for `Physics` is obviously `Transform`.
+			transform = &entity->GetComponent<Transform>();
+		}
+
+		// Called by `MovementKernel`, with the entity's own `Transform`.
+		void Move(Transform& target, FrameTime frameTime) const
+		{
+			target.position += velocity * Scalar(frameTime);
+
+			if(onOutOfBounds == nullptr) return;
+
+			if (left() < Scalar(0)) 
+				onOutOfBounds(sf::Vector2f{ 1.f, 0.f });
+			else if (right() > Scalar(windowWidth)) 
+				onOutOfBounds(sf::Vector2f{ -1.f, 0.f });
+
+			if (top() < Scalar(0)) 
+				onOutOfBounds(sf::Vector2f{ 0.f, 1.f });
+			else if (bottom() > Scalar(windowHeight)) 
+				onOutOfBounds(sf::Vector2f{ 0.f, -1.f });
+		}
+
+		Scalar x() 		const  noexcept { return transform->x(); }
+		Scalar y() 		const  noexcept { return transform->y(); }
+		Scalar left() 	const  noexcept { return x() - halfSize.x; }
+		Scalar right() 	const  noexcept { return x() + halfSize.x; }
+		Scalar top() 	const  noexcept { return y() - halfSize.y; }
+		Scalar bottom() const  noexcept { return y() + halfSize.y; }
+
+		void SetY(Scalar yValue) { transform->position.y = yValue; }
+	};
+
+	namespace Internal
+	{
+		template<typename T, typename TMember>
+		std::uint32_t GetFieldOffset(const T& object, const TMember& member) noexcept
+		{
+			return static_cast<std::uint32_t>(reinterpret_cast<const char*>(&member) 
+				- reinterpret_cast<const char*>(&object));
+		}
+
+		InspectorField MakeInspectorField(const char* name, InspectedFieldType type, std::uint32_t offset)
+		{
+			InspectorField field{};
+			std::strncpy(field.name, name, sizeof(field.name) - 1);
+			field.type = static_cast<std::uint32_t>(type);
+			field.offset = offset;
+			return field;
+		}
+	}
+
+	bool WorldInspector::Initialize()
+	{
+		// Field offsets are measured on sample objects, as our component
+		// types are polymorphic and `offsetof` can't be used on them.
+		EntityManager sampleManager;
+		Entity sampleEntity{ sampleManager };
+		Transform sampleTransform;
+		Physics samplePhysics{ Vec2{} };
+
+		auto vectorType(std::is_same<Scalar, Fixed>::value 
+			? InspectedFieldType::Fixed2 : InspectedFieldType::Float2);
+
+		struct TypeDescription
+		{
+			const char* name;
+			std::size_t size;
+			std::vector<InspectorField> fields;
+		};
+
+		std::array<TypeDescription, static_cast<std::size_t>(InspectedType::Count)> descriptions{ {
+			{ "Entity", sizeof(Entity), {
+				Internal::MakeInspectorField("alive", InspectedFieldType::Bool, 
+					Internal::GetFieldOffset(sampleEntity, sampleEntity.alive)),
+				Internal::MakeInspectorField("active", InspectedFieldType::Bool, 
+					Internal::GetFieldOffset(sampleEntity, sampleEntity.active)),
+				Internal::MakeInspectorField("groups", InspectedFieldType::Bits32, 
+					Internal::GetFieldOffset(sampleEntity, sampleEntity.groupBitset)) } },
+			{ "Transform", sizeof(Transform), {
+				Internal::MakeInspectorField("position", vectorType, 
+					Internal::GetFieldOffset(sampleTransform, sampleTransform.position)) } },
+			{ "Physics", sizeof(Physics), {
+				Internal::MakeInspectorField("velocity", vectorType, 
+					Internal::GetFieldOffset(samplePhysics, samplePhysics.velocity)),
+				Internal::MakeInspectorField("halfSize", vectorType, 
+					Internal::GetFieldOffset(samplePhysics, samplePhysics.halfSize)) } } 
+		} };
+
+		// Segment layout: header, then for every type its occupancy flags 
+		// followed by its slots.
+		const std::size_t alignment{64};
+		auto align([alignment](std::size_t value) { return (value + alignment - 1) / alignment * alignment; });
+
+		std::array<InspectorTypeInfo, static_cast<std::size_t>(InspectedType::Count)> types{};
+		auto segmentSize(align(sizeof(InspectorHeader)));
+
+		for (std::size_t i{0}; i < descriptions.size(); ++i)
+		{
+			auto& description(descriptions[i]);
+			auto& type(types[i]);
+
+			std::strncpy(type.name, description.name, sizeof(type.name) - 1);
+			type.slotSize = static_cast<std::uint32_t>(align(description.size));
+			type.slotCount = static_cast<std::uint32_t>(inspectorSlotCount);
+			type.occupancyOffset = segmentSize;
+			type.slotsOffset = align(segmentSize + inspectorSlotCount);
+			type.fieldCount = static_cast<std::uint32_t>(description.fields.size());
+			std::copy(std::begin(description.fields), std::end(description.fields), type.fields);
+
+			segmentSize = type.slotsOffset + type.slotSize * inspectorSlotCount;
+		}
+
+		if (!memory.Create(worldSegmentName, segmentSize)) return false;
+
+		auto base(static_cast<char*>(memory.GetData()));
+		header = new (base) InspectorHeader;
+		header->magic = InspectorHeader::expectedMagic;
+		header->version = InspectorHeader::expectedVersion;
+		header->segmentSize = segmentSize;
+		header->epoch.store(0, std::memory_order_relaxed);
+		header->typeCount = static_cast<std::uint32_t>(types.size());
+
+		for (std::size_t i{0}; i < types.size(); ++i)
+		{
+			header->types[i] = types[i];
+			header->overflowCounts[i].store(0, std::memory_order_relaxed);
+
+			auto& pool(pools[i]);
+			pool.occupancy = reinterpret_cast<std::uint8_t*>(base + types[i].occupancyOffset);
+			pool.slots = base + types[i].slotsOffset;
+			pool.slotSize = types[i].slotSize;
+			pool.slotCount = types[i].slotCount;
+
+			std::fill(pool.occupancy, pool.occupancy + pool.slotCount, std::uint8_t{0});
+
+			// Slots are handed out from the lowest address.
+			pool.freeSlots.resize(pool.slotCount);
+			for (std::size_t slot{0}; slot < pool.slotCount; ++slot)
+				pool.freeSlots[slot] = static_cast<std::uint32_t>(pool.slotCount - 1 - slot);
+		}
+
+		return true;
+	}
+
+	// Textures are shared: every file is loaded only once, and renderers
+	// refer to it with a small integer id.
+	using TextureID = std::uint16_t;
+
+	// Enemy ships are built on the workers, so the cache is shared between
+	// threads. Textures should still be loaded first by the main thread, 
+	// where the window's OpenGL context lives.
+	class TextureCache
+	{
+		private:
+			std::vector<std::string> filenames;
+			std::vector<std::unique_ptr<sf::Texture>> textures;
+			mutable std::mutex mutex;
+
+		public:
+			TextureID Load(const std::string& filename)
+			{
+				std::lock_guard<std::mutex> lock{ mutex };
+
+				auto it(std::find(std::begin(filenames), std::end(filenames), filename));
+				if (it != std::end(filenames))
+					return static_cast<TextureID>(it - std::begin(filenames));
+
+				std::unique_ptr<sf::Texture> texture{ new sf::Texture };
+				texture->loadFromFile(filename);
+
+				filenames.emplace_back(filename);
+				textures.emplace_back(std::move(texture));
+				return static_cast<TextureID>(textures.size() - 1);
+			}
+
+			const sf::Texture& Get(TextureID id) const
+			{
+				std::lock_guard<std::mutex> lock{ mutex };
+				return *textures[id];
+			}
+	};
+
+	// Sprites are drawn in layers, from the first to the last one.
+	enum RenderLayer : std::uint8_t
+	{
+		BulletLayer,
+		ShipLayer
+	};
+
+	// Everything the render queue needs to know to draw a textured quad.
+	struct Sprite
+	{
+		sf::Vector2f position, halfSize;
+		sf::FloatRect textureRect; // In pixels
+		TextureID texture;
+	};
+
+	namespace Internal
+	{
+		// LSD radix sort, one byte per pass. All the histograms are built
+		// with a single read of the keys, and passes where every key has 
+		// the same byte are skipped.
+		void RadixSort(std::vector<std::uint64_t>& keys, std::vector<std::uint64_t>& scratch)
+		{
+			auto count(keys.size());
+			if (count < 2) return;
+
+			scratch.resize(count);
+
+			std::array<std::array<std::size_t, 256>, 8> histograms{};
+			for (auto key : keys)
+			{
+				for (std::size_t digit{0}; digit < 8; ++digit)
+					++histograms[digit][(key >> (digit * 8)) & 0xFF];
+			}
+
+			auto source(keys.data());
+			auto destination(scratch.data());
+
+			for (std::size_t digit{0}; digit < 8; ++digit)
+			{
+				auto& histogram(histograms[digit]);
+				auto shift(digit * 8);
+
+				if (histogram[(source[0] >> shift) & 0xFF] == count) continue;
+
+				std::size_t offset{0};
+				for (auto& bucket : histogram)
+				{
+					auto bucketSize(bucket);
+					bucket = offset;
+					offset += bucketSize;
+				}
+
+				for (std::size_t i{0}; i < count; ++i)
+					destination[histogram[(source[i] >> shift) & 0xFF]++] = source[i];
+
+				std::swap(source, destination);
+			}
+
+			if (source != keys.data()) keys.swap(scratch);
+		}
+	}
+
+	// How far the rendered frame is between the last two ticks, from 0 
+	// (the previous tick) to 1 (the last one).
+	struct FrameInterpolation
+	{
+		float alpha{1.f};
+	};
+
+	// The gameplay keys, as the simulation sees them. The game fills them
+	// in from the `InputSampler` once per frame, and replays record them 
+	// as they are: components never read the keyboard themselves.
+	struct GameplayInput
+	{
+		enum Key : std::size_t { Left, Right, Fire };
+
+		std::array<bool, 3> keys{ { false, false, false } };
+	};
+
+	// The view scrolls to follow the player ship across the world, and 
+	// stops at the world's borders. Like a `Transform`, the camera keeps 
+	// its last two positions, so it moves as smoothly as the sprites.
+	class Camera
+	{
+		private:
+			float previousX{ windowWidth / 2.f }, x{ windowWidth / 2.f };
+
+		public:
+			// Called once per tick.
+			void Follow(const sf::Vector2f& focus) noexcept
+			{
+				previousX = x;
+				x = std::min(std::max(focus.x, windowWidth / 2.f), worldWidth - windowWidth / 2.f);
+			}
+
+			// Tells whether something `halfWidth` wide is on screen.
+			bool Sees(float centerX, float halfWidth) const noexcept
+			{
+				return std::abs(centerX - x) < windowWidth / 2.f + halfWidth;
+			}
+
+			sf::View GetView(float alpha) const
+			{
+				auto centerX(previousX + (x - previousX) * alpha);
+				return sf::View{ sf::Vector2f{ centerX, windowHeight / 2.f }, 
+					sf::Vector2f{ static_cast<float>(windowWidth), static_cast<float>(windowHeight) } };
+			}
+	};
+
+	// Instead of drawing immediately, renderers push their sprites to the 
+	// `RenderQueue`, which stores them as a structure of arrays.
+	// Every sprite gets a 64-bit sort key:
+	//
+	//     | layer (8) | texture (16) | depth (16) | submission index (24) |
+	//
+	// Sorting the keys groups sprites by layer first and by texture second,
+	// so each texture is bound once per layer, no matter the order in which
+	// entities were spawned. The submission index in the low bits makes the
+	// sort stable and tells us where the sprite is stored.
+	//
+	// Building the quads is split across the worker pool: every worker 
+	// writes a disjoint range of the preallocated vertex array, and only 
+	// the final draw calls happen on the render thread.
+	class RenderQueue
+	{
+		private:
+			static constexpr std::uint64_t indexBits{24}, depthBits{16}, textureBits{16};
+			static constexpr std::uint64_t indexMask{(1ull << indexBits) - 1};
+			static constexpr std::size_t spritesPerJob{4096};
+
+			struct Batch
+			{
+				TextureID texture;
+				std::size_t firstVertex, vertexCount;
+			};
+
+			std::vector<float> positionX, positionY, halfWidth, halfHeight;
+			std::vector<float> textureLeft, textureTop, textureWidth, textureHeight;
+			std::vector<TextureID> textureIDs;
+
+			std::vector<std::uint64_t> keys, scratch;
+			std::vector<sf::Vertex> vertices;
+			std::vector<Batch> batches;
+
+			void BuildBatches()
+			{
+				batches.clear();
+
+				for (std::size_t i{0}; i < keys.size(); ++i)
+				{
+					auto texture(textureIDs[keys[i] & indexMask]);
+
+					if (batches.empty() || batches.back().texture != texture)
+						batches.emplace_back(Batch{ texture, i * 4, 0 });
+
+					batches.back().vertexCount += 4;
+				}
+			}
+
+			void BuildVertices(std::size_t first, std::size_t last)
+			{
+				for (auto i(first); i < last; ++i)
+				{
+					auto sprite(keys[i] & indexMask);
+					auto quad(&vertices[i * 4]);
+
+					auto left(positionX[sprite] - halfWidth[sprite]);
+					auto right(positionX[sprite] + halfWidth[sprite]);
+					auto top(positionY[sprite] - halfHeight[sprite]);
+					auto bottom(positionY[sprite] + halfHeight[sprite]);
+
+					auto u0(textureLeft[sprite]), u1(u0 + textureWidth[sprite]);
+					auto v0(textureTop[sprite]), v1(v0 + textureHeight[sprite]);
+
+					quad[0] = sf::Vertex{ { left, top }, { u0, v0 } };
+					quad[1] = sf::Vertex{ { right, top }, { u1, v0 } };
+					quad[2] = sf::Vertex{ { right, bottom }, { u1, v1 } };
+					quad[3] = sf::Vertex{ { left, bottom }, { u0, v1 } };
+				}
+			}
+
+		public:
+			void Push(RenderLayer layer, std::uint16_t depth, const Sprite& sprite)
+			{
+				auto index(static_cast<std::uint64_t>(keys.size()));
+				assert(index <= indexMask);
+
+				auto key((static_cast<std::uint64_t>(layer) << (textureBits + depthBits + indexBits))
+					| (static_cast<std::uint64_t>(sprite.texture) << (depthBits + indexBits))
+					| (static_cast<std::uint64_t>(depth) << indexBits)
+					| index);
+
+				keys.emplace_back(key);
+				positionX.emplace_back(sprite.position.x);
+				positionY.emplace_back(sprite.position.y);
+				halfWidth.emplace_back(sprite.halfSize.x);
+				halfHeight.emplace_back(sprite.halfSize.y);
+				textureLeft.emplace_back(sprite.textureRect.left);
+				textureTop.emplace_back(sprite.textureRect.top);
+				textureWidth.emplace_back(sprite.textureRect.width);
+				textureHeight.emplace_back(sprite.textureRect.height);
+				textureIDs.emplace_back(sprite.texture);
+			}
+
+			void Flush(sf::RenderTarget& target, const TextureCache& textures, WorkerPool& workers)
+			{
+				Internal::RadixSort(keys, scratch);
+
+				BuildBatches();
+				vertices.resize(keys.size() * 4);
+
+				workers.ParallelFor(keys.size(), spritesPerJob, 
+					[this](std::size_t first, std::size_t last) { BuildVertices(first, last); });
+
+				for (auto& batch : batches)
+				{
+					sf::RenderStates states{ &textures.Get(batch.texture) };
+					target.draw(&vertices[batch.firstVertex], batch.vertexCount, sf::Quads, states);
+				}
+
+				Clear();
+			}
+
+			void Clear()
+			{
+				keys.clear();
+				positionX.clear();
+				positionY.clear();
+				halfWidth.clear();
+				halfHeight.clear();
+				textureLeft.clear();
+				textureTop.clear();
+				textureWidth.clear();
+				textureHeight.clear();
+				textureIDs.clear();
+			}
+	};
+
+	// An entity can have a rectangular shape 
+	// that can be rendered on screen.
+	struct RectangleRenderer : Component
+	{
+		Transform* transform{nullptr};
+		sf::Vector2f halfSize;
+		std::string textureFilename;
+		RenderLayer layer;
+
+		TextureID textureID{0};
+		sf::Vector2f textureSize;
+		sf::FloatRect textureRect;
+
+		RectangleRenderer(const sf::Vector2f& halfSize, const std::string& textureFilename, RenderLayer layer)
+			: halfSize{ halfSize }, textureFilename{ textureFilename }, layer{ layer } {}
+		
+		void Initialize() override;
+
+		// Selects the part of the texture to display, in normalized
+		// texture coordinates. A negative width mirrors the image.
+		void SetTextureRect(const sf::FloatRect& uv)
+		{
+			textureRect = sf::FloatRect{ uv.left * textureSize.x, uv.top * textureSize.y,
+				uv.width * textureSize.x, uv.height * textureSize.y };
+		}
+	};
+
+	// Sprite-sheet animations are split in two parts:
+	// * `AnimationClip`s are shared data: a list of frames, each one with 
+	//   its UV rectangle and its duration.
+	// * The playback state of every animated entity (current frame and time
+	//   left in it) is owned by the `AnimationSystem`, as a structure of 
+	//   arrays, so all timers are advanced in a single pass.
+	// The `Animation` component only links an entity to its playback slot.
+	using AnimationClipID = std::size_t;
+
+	struct AnimationClip
+	{
+		std::vector<sf::FloatRect> frames;
+		std::vector<FrameTime> frameDurations;
+	};
+
+	struct Animation;
+
+	class AnimationSystem
+	{
+		private:
+			std::vector<AnimationClip> clips;
+
+			std::vector<FrameTime> remainingTime;
+			std::vector<std::uint32_t> frameIndex;
+			std::vector<AnimationClipID> clipIDs;
+			std::vector<Animation*> owners;
+
+			// Animated ships are also created on the workers.
+			std::mutex mutex;
+
+		public:
+			AnimationClipID AddClip(AnimationClip clip)
+			{
+				assert(!clip.frames.empty() && clip.frames.size() == clip.frameDurations.size());
+
+				clips.emplace_back(std::move(clip));
+				return clips.size() - 1;
+			}
+
+			std::size_t Add(Animation& animation, AnimationClipID clipID);
+			void Remove(std::size_t slot);
+			void Update(FrameTime frameTime);
+	};
+
+	struct Animation : Component
+	{
+		RectangleRenderer* renderer{nullptr};
+		AnimationClipID clipID;
+		std::size_t slot{0};
+
+		Animation(AnimationClipID clipID) : clipID{ clipID } { }
+
+		void Initialize() override
+		{
+			// A requirement for `Animation` is `RectangleRenderer`.
+			renderer = &entity->GetComponent<RectangleRenderer>();
+			slot = entity->GetResource<AnimationSystem>().Add(*this, clipID);
+		}
+
+		~Animation()
+		{
+			entity->GetResource<AnimationSystem>().Remove(slot);
+		}
+	};
+
+	std::size_t AnimationSystem::Add(Animation& animation, AnimationClipID clipID)
+	{
+		std::lock_guard<std::mutex> lock{ mutex };
+		auto& clip(clips[clipID]);
+
+		remainingTime.emplace_back(clip.frameDurations.front());
+		frameIndex.emplace_back(0);
+		clipIDs.emplace_back(clipID);
+		owners.emplace_back(&animation);
+
+		animation.renderer->SetTextureRect(clip.frames.front());
+		return owners.size() - 1;
+	}
+
+	void AnimationSystem::Remove(std::size_t slot)
+	{
+		std::lock_guard<std::mutex> lock{ mutex };
+		auto last(owners.size() - 1);
+
+		remainingTime[slot] = remainingTime[last];
+		frameIndex[slot] = frameIndex[last];
+		clipIDs[slot] = clipIDs[last];
+		owners[slot] = owners[last];
+		owners[slot]->slot = slot;
+
+		remainingTime.pop_back();
+		frameIndex.pop_back();
+		clipIDs.pop_back();
+		owners.pop_back();
+	}
+
+	void AnimationSystem::Update(FrameTime frameTime)
+	{
+		auto count(remainingTime.size());
+		auto time(remainingTime.data());
+
+		// All the timers are advanced at once...
+		for (std::size_t i{0}; i < count; ++i)
+		{
+			time[i] -= frameTime;
+		}
+
+		// ...and only the animations whose frame is over do more work.
+		for (std::size_t i{0}; i < count; ++i)
+		{
+			if (time[i] > 0.f) continue;
+
+			auto& clip(clips[clipIDs[i]]);
+			auto frame(frameIndex[i]);
+
+			while (time[i] <= 0.f)
+			{
+				frame = (frame + 1) % clip.frames.size();
+				time[i] += clip.frameDurations[frame];
+			}
+
+			frameIndex[i] = frame;
+			owners[i]->renderer->SetTextureRect(clip.frames[frame]);
+		}
+	}
+
+	// The player ship needs a component to manage
+	// keyboard input.
+	struct PlayerController : Component
+	{
+		Transform* transform{ nullptr };
+		Physics* physics{nullptr};
+
+		float const fireRate = 1000.f; // In milliseconds
+		float accumulatedTime = fireRate + 1.f;
+		
+		void Initialize() override
+		{	
+			// A requirement for `PlayerController` is `Transform` and 'Physics'
+			transform = &entity->GetComponent<Transform>();
+			physics = &entity->GetComponent<Physics>();
+		}
+
+		void Update(FrameTime frameTime)
+		{
+			auto& input(entity->GetResource<GameplayInput>().keys);
+
+			if (input[GameplayInput::Left] && physics->left() > Scalar(0))
+			{
+				physics->velocity.x = Scalar(-playerShipVelocity);
+			}
+			else if (input[GameplayInput::Right] && physics->right() < Scalar(worldWidth))
+			{
+				physics->velocity.x = Scalar(playerShipVelocity);
+			}
+			else 
+			{
+				physics->velocity.x = Scalar(0);
+			}
+
+			accumulatedTime += frameTime;
+
+			if (input[GameplayInput::Fire])
+			{			
+				if (accumulatedTime > fireRate)
+				{
+					UsePlayerShipWeapon(transform->position);
 
 					// Reset Timer
 					accumulatedTime = 0.f;
 				} 
 			}	
-		}	
+		}	
+
+		void UsePlayerShipWeapon(const Vec2& bulletSpawnLocation);
+	};
+
+	// We'll use groups to keep track of our entities.
+	enum SpaceInvadersGroup : std::size_t
+	{
+		PlayerShip,
+		OffensiveEnemyShip,
+		PlayerBullet,
+		EnemyBullet,
+		DefensiveEnemyShip,
+		StreamedEntity
+	};
+
+	// Bullets are created once and reused: firing takes the next bullet 
+	// of the pool, in turn.
+	class ProjectilePool
+	{
+		private:
+			EntityManager& manager;
+			std::size_t currentPlayerBullet{0}, currentEnemyBullet{0};
+
+			Entity& Next(Group group, std::size_t& current)
+			{
+				auto& bullets(manager.GetEntitiesByGroup(group));
+
+				if (current >= bullets.size())
+				{
+					current = 0;
+				}
+
+				return *bullets[current++];
+			}
+
+		public:
+			ProjectilePool(EntityManager& manager) : manager(manager) { }
+
+			Entity& NextPlayerBullet() { return Next(PlayerBullet, currentPlayerBullet); }
+			Entity& NextEnemyBullet() { return Next(EnemyBullet, currentEnemyBullet); }
+	};
+
+	struct WeaponAIController : Component
+	{
+		Transform* transform{ nullptr };
+
+		// Every ship owns its own stream, so the fire pattern of a ship
+		// doesn't depend on how many other ships fired before it.
+		RandomStream randomStream;
+
+		// Delays are drawn `enemyFireDelayBatch` at a time. They are the
+		// same numbers one `NextInt` per shot would give.
+		std::array<int, enemyFireDelayBatch> fireDelays;
+		std::size_t nextFireDelay{ enemyFireDelayBatch };
+
+		float nextFireTimePoint = 0.f;
+		float accumulatedTime = 0.f;
+
+		WeaponAIController(const RandomStream& randomStream) : randomStream{ randomStream } {}
+
+		void Initialize() override
+		{
+			// A requirement for `WeaponAIController` is `Transform`.
+			transform = &entity->GetComponent<Transform>();
+
+			GetNextFireTimePoint();
+		}
+
+		void Update(float frameTime) override
+		{
+			accumulatedTime += frameTime;
+		
+			if (accumulatedTime > nextFireTimePoint)
+			{
+				// Ships out of sight hold their fire, so that they don't 
+				// use up the bullets of the ships on screen.
+				auto& camera(entity->GetResource<Camera>());
+				if (camera.Sees(static_cast<float>(transform->x()), enemyShipWidth / 2.f))
+					UseEnemyShipWeapon(transform->position);
+
+				GetNextFireTimePoint();
+
+				// Reset timer
+				accumulatedTime = 0.f;
+			}
+		}
+
+		void GetNextFireTimePoint()
+		{
+			if (nextFireDelay == fireDelays.size())
+			{
+				randomStream.FillInt(fireDelays.data(), fireDelays.size(), 1, 15);
+				nextFireDelay = 0;
+			}
+
+			nextFireTimePoint = static_cast<float>(fireDelays[nextFireDelay++] * 1000); // In milliseconds
+		}
+
+		void UseEnemyShipWeapon(const Vec2& bulletSpawnLocation);
+	};
+
+	// Enemy waves are described in a data file, one formation per line.
+	struct FormationDefinition
+	{
+		int columns{0}, rows{0};
+
+		// One character per row: 'O' for offensive ships, 'D' for defensive ones.
+		std::string rowPattern;
+
+		float velocity{enemyShipVelocity};
+
+		// In milliseconds. Zero means the wave stays until it's cleared.
+		FrameTime duration{0.f};
+
+		int GetSlotCount() const noexcept { return columns * rows; }
+	};
+
+	// Formation definitions are streamed: a single line is parsed every time
+	// a new wave is requested, and the file is rewound when it ends so waves
+	// keep coming.
+	class FormationStream
+	{
+		private:
+			std::ifstream file;
+
+		public:
+			FormationStream(const std::string& filename) : file{ filename } { }
+
+			bool Next(FormationDefinition& definition)
+			{
+				for (int attempt{0}; attempt < 2; ++attempt)
+				{
+					std::string line;
+					while (std::getline(file, line))
+					{
+						std::istringstream lineStream{ line };
+						std::string keyword;
+						float durationInSeconds{0.f};
+
+						// Lines look like: `wave <columns> <rows> <row pattern> <velocity> <duration>`.
+						// Everything else (empty lines, `#` comments) is skipped.
+						if (!(lineStream >> keyword) || keyword != "wave") continue;
+
+						if (lineStream >> definition.columns >> definition.rows
+							>> definition.rowPattern >> definition.velocity >> durationInSeconds)
+						{
+							definition.duration = durationInSeconds * 1000.f;
+							return true;
+						}
+					}
+
+					// Start over from the first formation.
+					file.clear();
+					file.seekg(0);
+				}
+
+				return false;
+			}
+	};
+
+	// The `WaveDirector` is in charge of the enemy formations. While a wave
+	// is being played, the next one is built in a separate staging manager,
+	// a few entities per frame within `spawnBudget`. When the active wave is 
+	// cleared (or its time is up) the staged wave is activated in bulk, and 
+	// the survivors of the previous one are destroyed.
+	struct WaveDirector
+	{
+		Game& game;
+		FormationStream formations;
+
+		// The next wave is built here, outside of the world.
+		EntityManager staging;
+		FormationDefinition stagedFormation;
+		int stagedSlot{0};
+		bool hasStagedFormation{false};
+
+		FormationDefinition activeFormation;
+		FrameTime activeWaveTime{0.f};
+		int waveNumber{0};
+
+		// Enemy ships in the world, kept up to date by observers.
+		int activeShipCount{0};
+
+		WaveDirector(Game& game, const std::string& filename)
+			: game(game), formations{ filename } { }
+
+		// Builds the first wave without any budget, as nothing is 
+		// running yet.
+		void Start();
+		void Update(FrameTime frameTime, const FrameBudget& budget);
+
+		void RequestNextFormation();
+		void BuildStagedWave(const FrameBudget* budget);
+		Entity& BuildShip(EntityManager& target, int slot) const;
+		bool IsStagedWaveReady() const noexcept;
+		void ActivateStagedWave();
+		void RetireActiveWave();
+		bool IsActiveWaveOver() const;
+	};
+
+	// Entities that live in the partitioned world can be unloaded to disk.
+	// They are stored as fixed-size records, which is all we need to 
+	// rebuild them later.
+	enum class EntityKind : std::uint8_t
+	{
+		OffensiveEnemyShip,
+		DefensiveEnemyShip
+	};
+
+	struct EntityRecord
+	{
+		std::uint8_t kind;
+		std::uint8_t padding[3];
+		std::uint32_t slot;
+		float x, y, velocityX, velocityY;
+	};
+
+	static_assert(sizeof(EntityRecord) == 24, "EntityRecord must stay compact");
+
+	// Cell loaders push the records they read here, as they go.
+	using LoadedRecordQueue = MpscQueue<EntityRecord, worldLoadQueueCapacity>;
+
+	// A `Streamable` component remembers what an entity is, so it can be
+	// saved when its cell is unloaded.
+	struct Streamable : Component
+	{
+		EntityKind kind;
+		std::uint32_t slot;
+
+		Streamable(EntityKind kind, std::uint32_t slot) : kind{ kind }, slot{ slot } { }
+
+		EntityRecord ToRecord() const
+		{
+			auto& physics(entity->GetComponent<Physics>());
+
+			EntityRecord record{};
+			record.kind = static_cast<std::uint8_t>(kind);
+			record.slot = slot;
+			record.x = ToFloat(physics.x());
+			record.y = ToFloat(physics.y());
+			record.velocityX = ToFloat(physics.velocity.x);
+			record.velocityY = ToFloat(physics.velocity.y);
+			return record;
+		}
+	};
+
+	// The `WorldPartition` keeps memory bounded: every frame it unloads the
+	// streamed entities that are too far from the focus point (appending 
+	// them to their cell file), and asynchronously reads back the cells that
+	// came into range. Loaders stream their records through a lock-free 
+	// queue, which is drained once per frame; the records are then turned 
+	// into entities on the main thread, within the per-frame spawn budget.
+	class WorldPartition
+	{
+		private:
+			struct Cell
+			{
+				bool loaded{false};
+				std::future<void> pendingLoad;
+
+				// Writes to the same cell file are chained, and a load waits
+				// for the last write to be done.
+				std::shared_future<void> pendingWrite;
+			};
+
+			Game& game;
+			RandomStream generationStream;
+
+			// Declared before `cells`: loaders still running when the 
+			// partition is destroyed push to it until they are done.
+			LoadedRecordQueue loadedRecords;
+			std::unordered_map<std::uint64_t, Cell> cells;
+			std::vector<EntityRecord> pendingSpawns;
+
+			// Range of active cells, inclusive.
+			int minCellX{0}, maxCellX{-1}, minCellY{0}, maxCellY{-1};
+
+			static std::uint64_t GetCellKey(int cellX, int cellY) noexcept
+			{
+				return (static_cast<std::uint64_t>(static_cast<std::uint32_t>(cellX)) << 32)
+					| static_cast<std::uint32_t>(cellY);
+			}
+
+			static std::string GetCellFilename(int cellX, int cellY)
+			{
+				return worldCellFilePrefix + std::to_string(cellX) + "-" + std::to_string(cellY) + ".bin";
+			}
+
+			static int GetLastCellX() noexcept { return static_cast<int>(std::ceil(worldWidth / worldCellSize)) - 1; }
+			static int GetLastCellY() noexcept { return static_cast<int>(std::ceil(worldHeight / worldCellSize)) - 1; }
+
+			// Entities that went past the edges of the world belong to the
+			// closest cell, so that they are loaded again with it.
+			static int GetCellX(Scalar x) noexcept
+			{
+				return std::min(GetLastCellX(), std::max(0, static_cast<int>(std::floor(ToFloat(x) / worldCellSize))));
+			}
+
+			static int GetCellY(Scalar y) noexcept
+			{
+				return std::min(GetLastCellY(), std::max(0, static_cast<int>(std::floor(ToFloat(y) / worldCellSize))));
+			}
+
+			bool IsCellActive(int cellX, int cellY) const noexcept
+			{
+				return cellX >= minCellX && cellX <= maxCellX 
+					&& cellY >= minCellY && cellY <= maxCellY;
+			}
+
+			void UpdateActiveRange(const sf::Vector2f& focus);
+			void StartLoadingActiveCells();
+			void DrainLoadedRecords();
+			void UnloadDistantEntities();
+			void SpawnPendingRecords(const FrameBudget& budget);
+
+		public:
+			WorldPartition(Game& game, const RandomService& random);
+
+			~WorldPartition();
+
+			void Update(const sf::Vector2f& focus, const FrameBudget& budget);
+
+			std::size_t GetLoadedCellCount() const noexcept;
+	};
+
+	// Particles are purely cosmetic and there can be a lot of them, so they
+	// don't go through the entity system at all. The `ParticleSystem` stores
+	// them as a structure of arrays: every update is a few straight loops
+	// over contiguous floats, which the compiler can vectorize.
+	// Dead particles are removed by swapping the last one in their place, 
+	// so the arrays always stay dense. Everything is drawn with a single
+	// vertex array.
+	class ParticleSystem
+	{
+		private:
+			std::vector<float> positionX, positionY;
+			std::vector<float> velocityX, velocityY;
+			std::vector<float> life, inverseLifetime;
+			std::vector<sf::Color> color;
+
+			std::vector<sf::Vertex> vertices;
+			RandomStream randomStream;
+
+			void SwapRemove(std::size_t i, std::size_t last)
+			{
+				positionX[i] = positionX[last];
+				positionY[i] = positionY[last];
+				velocityX[i] = velocityX[last];
+				velocityY[i] = velocityY[last];
+				life[i] = life[last];
+				inverseLifetime[i] = inverseLifetime[last];
+				color[i] = color[last];
+			}
+
+			void Resize(std::size_t count)
+			{
+				positionX.resize(count);
+				positionY.resize(count);
+				velocityX.resize(count);
+				velocityY.resize(count);
+				life.resize(count);
+				inverseLifetime.resize(count);
+				color.resize(count);
+			}
+
+		public:
+			ParticleSystem(const RandomService& random)
+				: randomStream{ random.GetStream(RandomStreamID::Particles) } { }
+
+			std::size_t GetCount() const noexcept { return life.size(); }
+
+			void Emit(const sf::Vector2f& position, const sf::Vector2f& velocity, 
+				float lifetime, const sf::Color& particleColor)
+			{
+				if (life.size() == maxParticles) return;
+
+				positionX.emplace_back(position.x);
+				positionY.emplace_back(position.y);
+				velocityX.emplace_back(velocity.x);
+				velocityY.emplace_back(velocity.y);
+				life.emplace_back(lifetime);
+				inverseLifetime.emplace_back(1.f / lifetime);
+				color.emplace_back(particleColor);
+			}
+
+			// Emits `count` particles in random directions.
+			void EmitBurst(const sf::Vector2f& position, int count, float maxSpeed,
+				float lifetime, const sf::Color& particleColor)
+			{
+				for (int i{0}; i < count; ++i)
+				{
+					sf::Vector2f velocity{ randomStream.NextFloat(-maxSpeed, maxSpeed),
+						randomStream.NextFloat(-maxSpeed, maxSpeed) };
+					Emit(position, velocity, randomStream.NextFloat(lifetime / 2.f, lifetime), particleColor);
+				}
+			}
+
+			// Emits a single particle going in `direction`, with some spread.
+			void EmitJet(const sf::Vector2f& position, const sf::Vector2f& direction, 
+				float spread, float lifetime, const sf::Color& particleColor)
+			{
+				sf::Vector2f velocity{ direction.x + randomStream.NextFloat(-spread, spread),
+					direction.y + randomStream.NextFloat(-spread, spread) };
+				Emit(position, velocity, lifetime, particleColor);
+			}
+
+			void Update(FrameTime frameTime)
+			{
+				auto count(life.size());
+				auto px(positionX.data());
+				auto py(positionY.data());
+				auto vx(velocityX.data());
+				auto vy(velocityY.data());
+				auto l(life.data());
+
+				// Integration: no branches and no dependencies between
+				// iterations, so it's done eight particles at a time.
+				auto step(Floatx8::Broadcast(frameTime));
+				std::size_t first{0};
+
+				for (; first + 8 <= count; first += 8)
+				{
+					auto position(Vec2x8::Load(px + first, py + first));
+					auto velocity(Vec2x8::Load(vx + first, vy + first));
+					MulAdd(velocity, step, position).Store(px + first, py + first);
+					(Floatx8::Load(l + first) - step).Store(l + first);
+				}
+
+				for (auto i(first); i < count; ++i)
+				{
+					px[i] += vx[i] * frameTime;
+					py[i] += vy[i] * frameTime;
+					l[i] -= frameTime;
+				}
+
+				// Compaction. Batches without any dead particle are skipped
+				// in one go.
+				auto zero(Floatx8::Broadcast(0.f));
+
+				for (std::size_t i{0}; i < count;)
+				{
+					if (i + 8 <= count && !(Floatx8::Load(l + i) <= zero).Any())
+					{
+						i += 8;
+						continue;
+					}
+
+					if (l[i] > 0.f)
+					{
+						++i;
+						continue;
+					}
+
+					SwapRemove(i, --count);
+				}
+
+				Resize(count);
+			}
+
+			void Draw(sf::RenderTarget& target)
+			{
+				auto count(life.size());
+				vertices.resize(count * 4);
+
+				const float halfSize{ particleSize / 2.f };
+
+				for (std::size_t i{0}; i < count; ++i)
+				{
+					// Particles fade out during their lifetime.
+					auto particleColor(color[i]);
+					particleColor.a = static_cast<sf::Uint8>(255.f * life[i] * inverseLifetime[i]);
+
+					auto quad(&vertices[i * 4]);
+					quad[0] = sf::Vertex{ { positionX[i] - halfSize, positionY[i] - halfSize }, particleColor };
+					quad[1] = sf::Vertex{ { positionX[i] + halfSize, positionY[i] - halfSize }, particleColor };
+					quad[2] = sf::Vertex{ { positionX[i] + halfSize, positionY[i] + halfSize }, particleColor };
+					quad[3] = sf::Vertex{ { positionX[i] - halfSize, positionY[i] + halfSize }, particleColor };
+				}
+
+				if (!vertices.empty())
+					target.draw(vertices.data(), vertices.size(), sf::Quads);
+			}
+	};
+
+	// The HUD uses a tiny built-in 5x7 pixel font, so the demo doesn't 
+	// need any font file. Glyphs are baked once into an atlas texture.
+	namespace Internal
+	{
+		struct GlyphBitmap
+		{
+			char character;
+			std::uint8_t rows[7]; // One bit per pixel, the leftmost pixel is bit 4.
+		};
+
+		const GlyphBitmap glyphBitmaps[]
+		{
+			{ '0', { 0x0E, 0x11, 0x13, 0x15, 0x19, 0x11, 0x0E } },
+			{ '1', { 0x04, 0x0C, 0x04, 0x04, 0x04, 0x04, 0x0E } },
+			{ '2', { 0x0E, 0x11, 0x01, 0x02, 0x04, 0x08, 0x1F } },
+			{ '3', { 0x1E, 0x01, 0x01, 0x0E, 0x01, 0x01, 0x1E } },
+			{ '4', { 0x02, 0x06, 0x0A, 0x12, 0x1F, 0x02, 0x02 } },
+			{ '5', { 0x1F, 0x10, 0x1E, 0x01, 0x01, 0x11, 0x0E } },
+			{ '6', { 0x06, 0x08, 0x10, 0x1E, 0x11, 0x11, 0x0E } },
+			{ '7', { 0x1F, 0x01, 0x02, 0x04, 0x08, 0x08, 0x08 } },
+			{ '8', { 0x0E, 0x11, 0x11, 0x0E, 0x11, 0x11, 0x0E } },
+			{ '9', { 0x0E, 0x11, 0x11, 0x0F, 0x01, 0x02, 0x0C } },
+			{ 'A', { 0x0E, 0x11, 0x11, 0x1F, 0x11, 0x11, 0x11 } },
+			{ 'C', { 0x0E, 0x11, 0x10, 0x10, 0x10, 0x11, 0x0E } },
+			{ 'E', { 0x1F, 0x10, 0x10, 0x1E, 0x10, 0x10, 0x1F } },
+			{ 'F', { 0x1F, 0x10, 0x10, 0x1E, 0x10, 0x10, 0x10 } },
+			{ 'I', { 0x0E, 0x04, 0x04, 0x04, 0x04, 0x04, 0x0E } },
+			{ 'K', { 0x11, 0x12, 0x14, 0x18, 0x14, 0x12, 0x11 } },
+			{ 'L', { 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x1F } },
+			{ 'M', { 0x11, 0x1B, 0x15, 0x15, 0x11, 0x11, 0x11 } },
+			{ 'N', { 0x11, 0x19, 0x15, 0x13, 0x11, 0x11, 0x11 } },
+			{ 'O', { 0x0E, 0x11, 0x11, 0x11, 0x11, 0x11, 0x0E } },
+			{ 'P', { 0x1E, 0x11, 0x11, 0x1E, 0x10, 0x10, 0x10 } },
+			{ 'R', { 0x1E, 0x11, 0x11, 0x1E, 0x14, 0x12, 0x11 } },
+			{ 'S', { 0x0F, 0x10, 0x10, 0x0E, 0x01, 0x01, 0x1E } },
+			{ 'T', { 0x1F, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04 } },
+			{ 'V', { 0x11, 0x11, 0x11, 0x11, 0x11, 0x0A, 0x04 } },
+			{ 'W', { 0x11, 0x11, 0x11, 0x15, 0x15, 0x15, 0x0A } },
+			{ ':', { 0x00, 0x0C, 0x0C, 0x00, 0x0C, 0x0C, 0x00 } },
+			{ '.', { 0x00, 0x00, 0x00, 0x00, 0x00, 0x0C, 0x0C } },
+		};
+	}
+
+	class GlyphAtlas
+	{
+		private:
+			static constexpr int glyphWidth{5}, glyphHeight{7}, cellWidth{6};
+
+			sf::Texture texture;
+			std::array<int, 128> glyphIndices;
+
+		public:
+			GlyphAtlas()
+			{
+				glyphIndices.fill(-1);
+
+				const int glyphCount(sizeof(Internal::glyphBitmaps) / sizeof(Internal::glyphBitmaps[0]));
+
+				sf::Image image;
+				image.create(glyphCount * cellWidth, glyphHeight, sf::Color::Transparent);
+
+				for (int i{0}; i < glyphCount; ++i)
+				{
+					auto& glyph(Internal::glyphBitmaps[i]);
+					glyphIndices[glyph.character] = i;
+
+					for (int y{0}; y < glyphHeight; ++y)
+					{
+						for (int x{0}; x < glyphWidth; ++x)
+						{
+							if (glyph.rows[y] & (1 << (glyphWidth - 1 - x)))
+								image.setPixel(i * cellWidth + x, y, sf::Color::White);
+						}
+					}
+				}
+
+				texture.loadFromImage(image);
+			}
+
+			const sf::Texture& GetTexture() const noexcept { return texture; }
+
+			sf::Vector2f GetGlyphSize() const noexcept 
+			{ 
+				return sf::Vector2f(glyphWidth, glyphHeight); 
+			}
+
+			// Returns `false` for characters the font doesn't have 
+			// (they're drawn as blanks).
+			bool GetGlyphRect(char character, sf::FloatRect& rect) const noexcept
+			{
+				auto index(character >= 0 ? glyphIndices[character] : -1);
+				if (index < 0) return false;
+
+				rect = sf::FloatRect(static_cast<float>(index * cellWidth), 0.f, 
+					static_cast<float>(glyphWidth), static_cast<float>(glyphHeight));
+				return true;
+			}
+	};
+
+	// The HUD is made of text runs. Each run owns a fixed range of a single
+	// vertex array, and its quads are rebuilt only when its text actually
+	// changes: static labels and unchanged numbers cost nothing per frame,
+	// and the whole HUD is drawn with one draw call.
+	using TextRunID = std::size_t;
+
+	class Hud
+	{
+		private:
+			struct TextRun
+			{
+				sf::Vector2f position;
+				std::string text;
+				std::size_t firstVertex;
+			};
+
+			GlyphAtlas atlas;
+			std::vector<TextRun> runs;
+			std::vector<sf::Vertex> vertices;
+
+			void RebuildRun(TextRun& run)
+			{
+				auto glyphSize(atlas.GetGlyphSize());
+				auto advance((glyphSize.x + 1.f) * hudScale);
+
+				for (std::size_t i{0}; i < hudRunLength; ++i)
+				{
+					auto quad(&vertices[run.firstVertex + i * 4]);
+					sf::FloatRect rect;
+
+					// Unused characters become empty quads.
+					if (i >= run.text.size() || !atlas.GetGlyphRect(run.text[i], rect))
+					{
+						for (int v{0}; v < 4; ++v) quad[v] = sf::Vertex{ run.position };
+						continue;
+					}
+
+					sf::Vector2f topLeft{ run.position.x + i * advance, run.position.y };
+					auto size(glyphSize * hudScale);
+
+					quad[0] = sf::Vertex{ topLeft, { rect.left, rect.top } };
+					quad[1] = sf::Vertex{ { topLeft.x + size.x, topLeft.y }, { rect.left + rect.width, rect.top } };
+					quad[2] = sf::Vertex{ topLeft + size, { rect.left + rect.width, rect.top + rect.height } };
+					quad[3] = sf::Vertex{ { topLeft.x, topLeft.y + size.y }, { rect.left, rect.top + rect.height } };
+				}
+			}
+
+		public:
+			TextRunID AddRun(const sf::Vector2f& position, const std::string& text = "")
+			{
+				runs.emplace_back(TextRun{ position, "", vertices.size() });
+				vertices.resize(vertices.size() + hudRunLength * 4);
+
+				auto id(runs.size() - 1);
+				RebuildRun(runs[id]);
+				SetText(id, text);
+				return id;
+			}
+
+			void SetText(TextRunID id, const std::string& text)
+			{
+				// Only the part that fits is stored, so that's what we 
+				// compare: a longer text would never match otherwise.
+				auto& run(runs[id]);
+				if (text.compare(0, hudRunLength, run.text) == 0) return;
+
+				run.text = text.substr(0, hudRunLength);
+				RebuildRun(run);
+			}
+
+			void Draw(sf::RenderTarget& target) const
+			{
+				if (vertices.empty()) return;
+
+				sf::RenderStates states{ &atlas.GetTexture() };
+				target.draw(vertices.data(), vertices.size(), sf::Quads, states);
+			}
+	};
+
+	// A fixed-bucket histogram. The last bucket collects everything that 
+	// doesn't fit in the others.
+	class Histogram
+	{
+		private:
+			float bucketWidth;
+			std::vector<std::uint32_t> buckets;
+			std::uint64_t count{0};
+			double sum{0.0};
+			float max{0.f};
+
+		public:
+			Histogram(float bucketWidth, std::size_t bucketCount) 
+				: bucketWidth{ bucketWidth }, buckets(bucketCount, 0) { }
+
+			void Add(float value)
+			{
+				auto bucket(static_cast<std::size_t>(std::max(0.f, value) / bucketWidth));
+				++buckets[std::min(bucket, buckets.size() - 1)];
+
+				++count;
+				sum += value;
+				max = std::max(max, value);
+			}
+
+			void Print(std::ostream& stream, const std::string& title) const
+			{
+				stream << title << ": " << count << " samples, mean " 
+					<< (count > 0 ? sum / count : 0.0) << " ms, max " << max << " ms\n";
+
+				for (std::size_t i{0}; i < buckets.size(); ++i)
+				{
+					if (buckets[i] == 0) continue;
+
+					stream << "  [" << i * bucketWidth << ", ";
+					if (i + 1 < buckets.size()) stream << (i + 1) * bucketWidth;
+					else stream << "inf";
+					stream << ") ms: " << buckets[i] << "\n";
+				}
+			}
+	};
+
+	// `sf::Window::setFramerateLimit` relies on `sf::sleep`, whose accuracy
+	// depends on the OS scheduler. The `FramePacer` sleeps only until it's
+	// close to the deadline and then spins for the remainder. Frames are 
+	// paced against a fixed period, and optionally frames that are already 
+	// late can be dropped instead of being presented.
+	class FramePacer
+	{
+		private:
+			using Clock = std::chrono::high_resolution_clock;
+
+			Clock::duration period;
+			Clock::time_point deadline{Clock::now()}, lastPresent{Clock::now()};
+			bool dropLateFrames;
+
+			// Distance between the actual and the target frame period.
+			Histogram jitter{ 0.1f, 50 };
+			std::uint64_t droppedFrames{0};
+
+			void AdvanceDeadline(Clock::time_point now)
+			{
+				deadline += period;
+
+				// If we're hopelessly behind, don't try to catch up.
+				if (deadline < now) deadline = now + period;
+			}
+
+		public:
+			FramePacer(FrameTime targetPeriod, bool dropLateFrames)
+				: period{ std::chrono::duration_cast<Clock::duration>(
+					std::chrono::duration<float, std::milli>(targetPeriod)) },
+				dropLateFrames{ dropLateFrames }
+			{ 
+				deadline += period;
+			}
+
+			bool ShouldPresent() const
+			{
+				return !dropLateFrames || Clock::now() <= deadline;
+			}
+
+			void WaitForDeadline() const
+			{
+				auto spinStart(deadline - std::chrono::duration_cast<Clock::duration>(
+					std::chrono::duration<float, std::milli>(pacingSpinMargin)));
+
+				if (Clock::now() < spinStart)
+					std::this_thread::sleep_until(spinStart);
+
+				while (Clock::now() < deadline) { }
+			}
+
+			void OnPresented(Clock::time_point now)
+			{
+				auto actualPeriod(std::chrono::duration_cast<std::chrono::duration<
+					float, std::milli>>(now - lastPresent).count());
+				auto targetPeriod(std::chrono::duration_cast<std::chrono::duration<
+					float, std::milli>>(period).count());
+
+				jitter.Add(std::abs(actualPeriod - targetPeriod));
+				lastPresent = now;
+				AdvanceDeadline(now);
+			}
+
+			void OnDropped(Clock::time_point now)
+			{
+				++droppedFrames;
+				AdvanceDeadline(now);
+			}
+
+			void PrintReport(std::ostream& stream) const
+			{
+				jitter.Print(stream, "Frame pacing jitter");
+				stream << "Dropped frames: " << droppedFrames << "\n";
+			}
+	};
+
+	// Measures input-to-photon latency: every time the input changes, the
+	// sample is tagged with the time it was read. When the frame that 
+	// reflects it is presented, the elapsed time is recorded.
+	class InputLatencyTracker
+	{
+		private:
+			using Clock = std::chrono::high_resolution_clock;
+
+			Clock::time_point pendingSample;
+			bool hasPendingSample{false};
+			Histogram latency{ 1.f, 50 };
+
+		public:
+			void TagSample(Clock::time_point sampleTime)
+			{
+				// If the previous sample hasn't been presented yet (e.g. its
+				// frame was dropped), we keep the oldest timestamp.
+				if (hasPendingSample) return;
+
+				pendingSample = sampleTime;
+				hasPendingSample = true;
+			}
+
+			void OnPresented(Clock::time_point now)
+			{
+				if (!hasPendingSample) return;
+
+				latency.Add(std::chrono::duration_cast<std::chrono::duration<
+					float, std::milli>>(now - pendingSample).count());
+				hasPendingSample = false;
+			}
+
+			void PrintReport(std::ostream& stream) const
+			{
+				latency.Print(stream, "Input-to-photon latency");
+			}
+	};
+
+	// A change of the gameplay keys (left, right, fire), and when it was 
+	// seen.
+	struct InputSample
+	{
+		std::array<bool, 3> keys;
+		std::chrono::high_resolution_clock::time_point time;
+	};
+
+	// On Windows the keyboard is sampled by a thread of its own, every 
+	// `inputSamplePeriod`: changes are timestamped when they happen rather
+	// than when the next frame starts, and handed to the simulation through 
+	// an `MpscQueue`. SFML's keyboard isn't safe to use off the main thread
+	// with X11 and Cocoa, so there `Poll` samples it once per frame instead,
+	// through the same queue.
+	class InputSampler
+	{
+		private:
+			MpscQueue<InputSample, inputQueueCapacity> samples;
+			std::vector<InputSample> drained;
+			std::array<bool, 3> lastKeys{ { false, false, false } };
+			std::atomic<bool> running{true};
+			std::thread thread;
+
+			// A change that doesn't fit in the queue is seen again at the 
+			// next sample.
+			void Sample()
+			{
+				std::array<bool, 3> keys{ {
+					sf::Keyboard::isKeyPressed(sf::Keyboard::Key::Left),
+					sf::Keyboard::isKeyPressed(sf::Keyboard::Key::Right),
+					sf::Keyboard::isKeyPressed(sf::Keyboard::Key::Space) } };
+
+				if (keys == lastKeys) return;
+
+				if (samples.TryPush(InputSample{ keys, std::chrono::high_resolution_clock::now() }))
+					lastKeys = keys;
+			}
+
+		public:
+			InputSampler()
+			{
+#ifdef _WIN32
+				thread = std::thread{ [this]
+				{
+					auto period(std::chrono::duration_cast<std::chrono::high_resolution_clock::duration>(
+						std::chrono::duration<float, std::milli>(inputSamplePeriod)));
+
+					while (running.load(std::memory_order_relaxed))
+					{
+						Sample();
+						std::this_thread::sleep_for(period);
+					}
+				} };
+#endif
+			}
+
+			InputSampler(const InputSampler&) = delete;
+			InputSampler& operator=(const InputSampler&) = delete;
+
+			~InputSampler()
+			{
+				running = false;
+				if (thread.joinable()) thread.join();
+			}
+
+			// Called by the main thread once per frame.
+			void Poll()
+			{
+				if (!thread.joinable()) Sample();
+			}
+
+			// Calls `function(sample)` for every change since the last call, 
+			// oldest first.
+			template<typename TFunction> void Drain(TFunction function)
+			{
+				drained.clear();
+				samples.PopBatch(std::back_inserter(drained), inputQueueCapacity);
+
+				for (auto& sample : drained) function(sample);
+			}
+	};
+
+	namespace Internal
+	{
+		// Sends a report everywhere it can be read: the console, the 
+		// debugger's output window and `reportFilename`.
+		inline void WriteReport(const std::string& report)
+		{
+			std::cout << report;
+
+#ifdef _WIN32
+			OutputDebugStringA(report.c_str());
+#endif
+
+			std::ofstream file{ reportFilename };
+			file << report;
+		}
+
+		// Windows builds have no console of their own, so the command line
+		// tools borrow the one they were started from, or open a new one.
+		inline void OpenConsole()
+		{
+#ifdef _WIN32
+			if (GetConsoleWindow() != nullptr) return;
+			if (!::AttachConsole(ATTACH_PARENT_PROCESS) && !::AllocConsole()) return;
+
+			FILE* stream{nullptr};
+			freopen_s(&stream, "CONOUT$", "w", stdout);
+			freopen_s(&stream, "CONOUT$", "w", stderr);
+			std::cout.clear();
+			std::cerr.clear();
+#endif
+		}
+	}
+
+	// What the game publishes every frame.
+	struct StatsSnapshot
+	{
+		std::uint64_t frame;
+		float frameTime, tickTime; // In milliseconds
+		std::uint32_t entityCount, graveyardCount, particleCount;
+		std::uint32_t groupCounts[maxGroups];
+		std::uint32_t activePlayerBullets, activeEnemyBullets;
+		std::uint64_t createdEntityCount;
+		std::uint64_t collisionPairCount;
+		std::uint64_t timestamp; // Milliseconds since the game started
+		std::uint32_t inspectorOverflowCount; // Objects the shared world couldn't hold
+	};
+
+	// The stats block is protected by a seqlock: the writer makes the 
+	// sequence odd, writes the snapshot and makes it even again. Readers
+	// copy the snapshot and retry if the sequence changed meanwhile or was
+	// odd. The writer never waits on anything, which keeps its cost down
+	// to a `memcpy` per frame.
+	struct StatsBlock
+	{
+		static constexpr std::uint32_t expectedMagic{0x53495354}, expectedVersion{2};
+
+		std::uint32_t magic;
+		std::uint32_t version;
+		std::atomic<std::uint32_t> sequence;
+		StatsSnapshot snapshot;
+
+		void Write(const StatsSnapshot& source) noexcept
+		{
+			auto current(sequence.load(std::memory_order_relaxed));
+
+			sequence.store(current + 1, std::memory_order_relaxed);
+			std::atomic_thread_fence(std::memory_order_release);
+
+			std::memcpy(&snapshot, &source, sizeof(StatsSnapshot));
+
+			sequence.store(current + 2, std::memory_order_release);
+		}
+
+		StatsSnapshot Read() const noexcept
+		{
+			StatsSnapshot result;
+
+			while (true)
+			{
+				auto before(sequence.load(std::memory_order_acquire));
+				if (before & 1u) continue;
+
+				std::memcpy(&result, &snapshot, sizeof(StatsSnapshot));
+				std::atomic_thread_fence(std::memory_order_acquire);
+
+				if (sequence.load(std::memory_order_relaxed) == before) 
+					return result;
+			}
+		}
+	};
+
+	static_assert(ATOMIC_INT_LOCK_FREE == 2, 
+		"The seqlock needs lock-free atomics to work across processes");
+
+	class StatsPublisher
+	{
+		private:
+			SharedMemory memory;
+			StatsBlock* block{nullptr};
+
+		public:
+			StatsPublisher()
+			{
+				if (!memory.Create(statsSegmentName, sizeof(StatsBlock))) 
+				{
+					std::cerr << "Can't create the stats shared memory segment\n";
+					return;
+				}
+
+				block = new (memory.GetData()) StatsBlock;
+				block->magic = StatsBlock::expectedMagic;
+				block->version = StatsBlock::expectedVersion;
+				block->sequence.store(0, std::memory_order_relaxed);
+			}
+
+			void Publish(const StatsSnapshot& snapshot) noexcept
+			{
+				if (block != nullptr) block->Write(snapshot);
+			}
+	};
+
+	// A small LZ77 codec in the spirit of LZ4: fast to compress, very fast
+	// to decompress, and good enough on the repetitive data we record.
+	// The compressed stream is a list of sequences:
+	//
+	//     [token][literal length+][literals][offset (2)][match length+]
+	//
+	// The high nibble of the token is the literal length and the low nibble
+	// the match length minus `minMatch`. A nibble of 15 means more length
+	// bytes follow (255 means "keep going"). The last sequence only has
+	// literals.
+	namespace Compression
+	{
+		namespace Internal
+		{
+			const std::size_t minMatch{4}, hashBits{12}, maxOffset{65535};
+
+			inline std::uint32_t Read32(const std::uint8_t* data) noexcept
+			{
+				std::uint32_t value;
+				std::memcpy(&value, data, sizeof(value));
+				return value;
+			}
+
+			inline std::size_t Hash(std::uint32_t value) noexcept
+			{
+				return (value * 2654435761u) >> (32 - hashBits);
+			}
+
+			inline void WriteLength(std::vector<std::uint8_t>& output, std::size_t length)
+			{
+				for (; length >= 255; length -= 255) output.emplace_back(255);
+				output.emplace_back(static_cast<std::uint8_t>(length));
+			}
+
+			inline bool ReadLength(const std::uint8_t*& input, const std::uint8_t* end, std::size_t& length)
+			{
+				std::uint8_t value;
+				do
+				{
+					if (input == end) return false;
+					value = *input++;
+					length += value;
+				} while (value == 255);
+
+				return true;
+			}
+
+			inline void WriteSequence(std::vector<std::uint8_t>& output, const std::uint8_t* literals, 
+				std::size_t literalLength, std::size_t offset, std::size_t matchLength)
+			{
+				auto matchCode(matchLength >= minMatch ? matchLength - minMatch : 0);
+
+				output.emplace_back(static_cast<std::uint8_t>(
+					(std::min<std::size_t>(literalLength, 15) << 4) | std::min<std::size_t>(matchCode, 15)));
+
+				if (literalLength >= 15) WriteLength(output, literalLength - 15);
+				output.insert(std::end(output), literals, literals + literalLength);
+
+				if (matchLength == 0) return;
+
+				output.emplace_back(static_cast<std::uint8_t>(offset & 0xFF));
+				output.emplace_back(static_cast<std::uint8_t>(offset >> 8));
+				if (matchCode >= 15) WriteLength(output, matchCode - 15);
+			}
+		}
+
+		inline std::vector<std::uint8_t> Compress(const std::uint8_t* data, std::size_t size)
+		{
+			using namespace Internal;
+
+			std::vector<std::uint8_t> output;
+			output.reserve(size + size / 255 + 16);
+
+			std::vector<std::int64_t> table(std::size_t{1} << hashBits, -1);
+			std::size_t anchor{0}, i{0};
+
+			while (i + minMatch <= size)
+			{
+				auto value(Read32(data + i));
+				auto& entry(table[Hash(value)]);
+				auto candidate(entry);
+				entry = static_cast<std::int64_t>(i);
+
+				if (candidate < 0 || i - candidate > maxOffset || Read32(data + candidate) != value)
+				{
+					++i;
+					continue;
+				}
+
+				auto matchLength(minMatch);
+				while (i + matchLength < size && data[candidate + matchLength] == data[i + matchLength])
+					++matchLength;
+
+				WriteSequence(output, data + anchor, i - anchor, i - candidate, matchLength);
+				i += matchLength;
+				anchor = i;
+			}
+
+			WriteSequence(output, data + anchor, size - anchor, 0, 0);
+			return output;
+		}
+
+		// Returns `false` if the data is corrupted or doesn't decompress to
+		// exactly `outputSize` bytes.
+		inline bool Decompress(const std::uint8_t* data, std::size_t size, 
+			std::uint8_t* output, std::size_t outputSize)
+		{
+			using namespace Internal;
+
+			auto input(data), inputEnd(data + size);
+			std::size_t written{0};
+
+			while (input < inputEnd)
+			{
+				auto token(*input++);
+
+				std::size_t literalLength(token >> 4);
+				if (literalLength == 15 && !ReadLength(input, inputEnd, literalLength)) return false;
+
+				if (literalLength > static_cast<std::size_t>(inputEnd - input) 
+					|| literalLength > outputSize - written) return false;
+
+				if (literalLength > 0) std::memcpy(output + written, input, literalLength);
+				input += literalLength;
+				written += literalLength;
+
+				if (input == inputEnd) break;
+
+				if (inputEnd - input < 2) return false;
+				std::size_t offset(input[0] | (input[1] << 8));
+				input += 2;
+
+				std::size_t matchLength(token & 15);
+				if (matchLength == 15 && !ReadLength(input, inputEnd, matchLength)) return false;
+				matchLength += minMatch;
+
+				if (offset == 0 || offset > written || matchLength > outputSize - written) return false;
+
+				// Matches can overlap with the bytes they produce, so they
+				// are copied one byte at a time.
+				for (std::size_t j{0}; j < matchLength; ++j, ++written)
+					output[written] = output[written - offset];
+			}
+
+			return written == outputSize;
+		}
+	}
+
+	// Replays record every tick of a session. They are split in chunks of
+	// `replayKeyframeInterval` ticks: each chunk starts with a full 
+	// snapshot of the world, followed by the input of each of its ticks, 
+	// and is compressed on its own. Jumping to a tick only needs to 
+	// decompress one chunk, and the index at the end of the file tells 
+	// where that chunk is.
+	//
+	//     file:    [ReplayFileHeader][chunk]...[chunk][chunk offsets][ReplayFooter]
+	//     chunk:   [ReplayChunkHeader][compressed payload]
+	//     payload: [ReplaySnapshotHeader][ReplayEntityState...][input...]
+	//
+	// All the integers are little-endian, like the machines we run on.
+	struct ReplayFileHeader
+	{
+		static constexpr std::uint32_t expectedMagic{0x53495250}, expectedVersion{1};
+
+		std::uint32_t magic, version;
+		std::uint32_t keyframeInterval;
+		std::uint32_t reserved;
+	};
+
+	struct ReplayChunkHeader
+	{
+		std::uint64_t firstTick;
+		std::uint32_t tickCount;
+		std::uint32_t rawSize, compressedSize;
+		std::uint32_t reserved;
+	};
+
+	struct ReplayFooter
+	{
+		std::uint64_t indexOffset, chunkCount;
+		std::uint32_t magic, reserved;
+	};
+
+	struct ReplaySnapshotHeader
+	{
+		std::uint64_t tick;
+		std::int32_t score;
+		std::uint32_t entityCount;
+	};
+
+	struct ReplayEntityState
+	{
+		enum : std::uint32_t { Alive = 1, Active = 2 };
+
+		std::uint32_t groups, flags;
+		float x, y, velocityX, velocityY;
+	};
+
+	// One byte of input per tick.
+	enum ReplayInput : std::uint8_t
+	{
+		ReplayLeft = 1,
+		ReplayRight = 2,
+		ReplayFire = 4
+	};
+
+	static_assert(sizeof(ReplayChunkHeader) == 24 && sizeof(ReplayFooter) == 24 
+		&& sizeof(ReplaySnapshotHeader) == 16 && sizeof(ReplayEntityState) == 24,
+		"Replay records must not contain padding");
+
+	// The simulation hands finished chunks over to a background thread, 
+	// which compresses and writes them. The queue between the two is 
+	// bounded, and the simulation usually doesn't wait for it: if the queue
+	// is full or busy, chunks are kept aside and handed over later. Chunks 
+	// can't be dropped, as the reader finds them by position, so when the 
+	// writer falls `replayBacklogCapacity` chunks behind (the disk can't 
+	// keep up at all) the simulation waits for it instead.
+	class ReplayRecorder
+	{
+		private:
+			struct PendingChunk
+			{
+				ReplayChunkHeader header{};
+				std::vector<std::uint8_t> payload;
+			};
+
+			std::uint32_t keyframeInterval;
+			bool enabled{false};
+
+			// Simulation side.
+			PendingChunk current;
+			std::deque<PendingChunk> backlog;
+
+			// Shared with the writer thread.
+			std::mutex mutex;
+			std::condition_variable condition, queueSpace;
+			std::deque<PendingChunk> queue;
+			bool stopping{false};
+
+			// Writer side.
+			std::ofstream file;
+			std::uint64_t fileOffset{0};
+			std::vector<std::uint64_t> chunkOffsets;
+			std::thread writer;
+
+			void Submit()
+			{
+				if (current.header.tickCount == 0) return;
+
+				backlog.emplace_back(std::move(current));
+				current = PendingChunk{};
+				HandOver(backlog.size() > replayBacklogCapacity);
+			}
+
+			void HandOver(bool wait = false)
+			{
+				std::unique_lock<std::mutex> lock{ mutex, std::defer_lock };
+
+				if (wait)
+				{
+					lock.lock();
+					queueSpace.wait(lock, [this] { return queue.size() < replayQueueCapacity; });
+				}
+				else if (!lock.try_lock()) return;
+
+				while (!backlog.empty() && queue.size() < replayQueueCapacity)
+				{
+					queue.emplace_back(std::move(backlog.front()));
+					backlog.pop_front();
+				}
+
+				lock.unlock();
+				condition.notify_one();
+			}
+
+			void Write(const void* data, std::size_t size)
+			{
+				file.write(static_cast<const char*>(data), size);
+				fileOffset += size;
+			}
+
+			void WriteChunk(PendingChunk& chunk)
+			{
+				auto compressed(Compression::Compress(chunk.payload.data(), chunk.payload.size()));
+
+				chunk.header.rawSize = static_cast<std::uint32_t>(chunk.payload.size());
+				chunk.header.compressedSize = static_cast<std::uint32_t>(compressed.size());
+
+				chunkOffsets.emplace_back(fileOffset);
+				Write(&chunk.header, sizeof(ReplayChunkHeader));
+				Write(compressed.data(), compressed.size());
+			}
+
+			void RunWriter()
+			{
+				while (true)
+				{
+					PendingChunk chunk;
+					{
+						std::unique_lock<std::mutex> lock{ mutex };
+						condition.wait(lock, [this] { return stopping || !queue.empty(); });
+
+						if (queue.empty()) break;
+
+						chunk = std::move(queue.front());
+						queue.pop_front();
+					}
+
+					queueSpace.notify_one();
+					WriteChunk(chunk);
+				}
+
+				// The index is only written when the session ends properly.
+				// The reader can rebuild it from the chunk headers otherwise.
+				ReplayFooter footer{ fileOffset, chunkOffsets.size(), ReplayFileHeader::expectedMagic, 0 };
+				Write(chunkOffsets.data(), chunkOffsets.size() * sizeof(std::uint64_t));
+				Write(&footer, sizeof(ReplayFooter));
+				file.flush();
+			}
+
+		public:
+			// An empty filename disables recording.
+			ReplayRecorder(const std::string& filename, std::uint32_t keyframeInterval) 
+				: keyframeInterval(keyframeInterval)
+			{
+				if (filename.empty()) return;
+
+				file.open(filename, std::ios::binary | std::ios::trunc);
+				if (!file)
+				{
+					std::cerr << "Can't record the replay to " << filename << "\n";
+					return;
+				}
+
+				ReplayFileHeader header{ ReplayFileHeader::expectedMagic, 
+					ReplayFileHeader::expectedVersion, keyframeInterval, 0 };
+				Write(&header, sizeof(ReplayFileHeader));
+
+				enabled = true;
+				writer = std::thread{ [this] { RunWriter(); } };
+			}
+
+			ReplayRecorder(const ReplayRecorder&) = delete;
+			ReplayRecorder& operator=(const ReplayRecorder&) = delete;
+
+			~ReplayRecorder()
+			{
+				if (!enabled) return;
+
+				// At exit, the chunks left behind are handed over no matter
+				// how long it takes.
+				Submit();
+				{
+					std::lock_guard<std::mutex> lock{ mutex };
+					std::move(std::begin(backlog), std::end(backlog), std::back_inserter(queue));
+					backlog.clear();
+					stopping = true;
+				}
+				condition.notify_one();
+				writer.join();
+			}
+
+			bool IsKeyframe(std::uint64_t tick) const noexcept
+			{
+				return enabled && tick % keyframeInterval == 0;
+			}
+
+			// Closes the current chunk and starts a new one from the 
+			// snapshot of the world at the beginning of `tick`.
+			void BeginChunk(std::uint64_t tick, std::vector<std::uint8_t> snapshot)
+			{
+				Submit();
+
+				current.header = ReplayChunkHeader{ tick, 0, 0, 0, 0 };
+				current.payload = std::move(snapshot);
+				current.payload.reserve(current.payload.size() + keyframeInterval);
+			}
+
+			void RecordInput(std::uint8_t input)
+			{
+				if (!enabled) return;
+
+				current.payload.emplace_back(input);
+				++current.header.tickCount;
+
+				if (!backlog.empty()) HandOver();
+			}
+	};
+
+	// What the reader returns when seeking: the snapshot the tick's chunk
+	// starts with, and the inputs from there up to the tick (included).
+	// The pointers are valid until the next seek.
+	struct ReplayFrame
+	{
+		ReplaySnapshotHeader snapshot;
+		const ReplayEntityState* entities;
+		const std::uint8_t* inputs;
+		std::uint32_t inputCount;
+	};
+
+	class ReplayReader
+	{
+		private:
+			MappedFile file;
+			ReplayFileHeader header;
+			std::vector<std::uint64_t> chunkOffsets;
+			std::uint64_t tickCount{0};
+
+			std::vector<std::uint8_t> chunkData;
+			std::size_t decodedChunk{SIZE_MAX};
+
+			template<typename T> bool Read(std::uint64_t offset, T& value) const noexcept
+			{
+				if (offset > file.GetSize() || file.GetSize() - offset < sizeof(T)) return false;
+
+				std::memcpy(&value, file.GetData() + offset, sizeof(T));
+				return true;
+			}
+
+			bool ReadIndex()
+			{
+				ReplayFooter footer;
+				if (file.GetSize() < sizeof(ReplayFileHeader) + sizeof(ReplayFooter)
+					|| !Read(file.GetSize() - sizeof(ReplayFooter), footer)
+					|| footer.magic != ReplayFileHeader::expectedMagic
+					|| footer.chunkCount > file.GetSize() / sizeof(std::uint64_t)
+					|| footer.indexOffset + footer.chunkCount * sizeof(std::uint64_t) 
+						!= file.GetSize() - sizeof(ReplayFooter)) return false;
+
+				chunkOffsets.resize(static_cast<std::size_t>(footer.chunkCount));
+				if (!chunkOffsets.empty())
+				{
+					std::memcpy(chunkOffsets.data(), file.GetData() + footer.indexOffset, 
+						chunkOffsets.size() * sizeof(std::uint64_t));
+				}
+				return true;
+			}
+
+			// Used when a session didn't end properly: every complete 
+			// chunk is still readable.
+			void RebuildIndex()
+			{
+				chunkOffsets.clear();
+
+				std::uint64_t offset{sizeof(ReplayFileHeader)};
+				ReplayChunkHeader chunk;
+				while (Read(offset, chunk) 
+					&& file.GetSize() - offset - sizeof(ReplayChunkHeader) >= chunk.compressedSize)
+				{
+					chunkOffsets.emplace_back(offset);
+					offset += sizeof(ReplayChunkHeader) + chunk.compressedSize;
+				}
+			}
+
+		public:
+			bool Open(const std::string& filename)
+			{
+				if (!file.Open(filename) || !Read(0, header)) return false;
+
+				if (header.magic != ReplayFileHeader::expectedMagic 
+					|| header.version != ReplayFileHeader::expectedVersion
+					|| header.keyframeInterval == 0) return false;
+
+				if (!ReadIndex()) RebuildIndex();
+
+				ReplayChunkHeader last;
+				if (!chunkOffsets.empty() && Read(chunkOffsets.back(), last))
+					tickCount = last.firstTick + last.tickCount;
+
+				return true;
+			}
+
+			std::uint64_t GetTickCount() const noexcept { return tickCount; }
+			std::size_t GetChunkCount() const noexcept { return chunkOffsets.size(); }
+
+			// Chunks are exactly `keyframeInterval` ticks long, so finding
+			// the one that contains `tick` is a division.
+			bool Seek(std::uint64_t tick, ReplayFrame& frame)
+			{
+				if (tick >= tickCount) return false;
+
+				auto index(static_cast<std::size_t>(tick / header.keyframeInterval));
+				if (index >= chunkOffsets.size()) return false;
+
+				ReplayChunkHeader chunk;
+				auto offset(chunkOffsets[index]);
+				if (!Read(offset, chunk) || tick < chunk.firstTick || tick - chunk.firstTick >= chunk.tickCount)
+					return false;
+
+				if (decodedChunk != index)
+				{
+					offset += sizeof(ReplayChunkHeader);
+					if (file.GetSize() - offset < chunk.compressedSize) return false;
+
+					chunkData.resize(chunk.rawSize);
+					if (!Compression::Decompress(file.GetData() + offset, chunk.compressedSize, 
+						chunkData.data(), chunkData.size())) return false;
+
+					decodedChunk = index;
+				}
+
+				if (chunkData.size() < sizeof(ReplaySnapshotHeader)) return false;
+				std::memcpy(&frame.snapshot, chunkData.data(), sizeof(ReplaySnapshotHeader));
+
+				auto entitiesSize(static_cast<std::size_t>(frame.snapshot.entityCount) * sizeof(ReplayEntityState));
+				if (sizeof(ReplaySnapshotHeader) + entitiesSize + chunk.tickCount != chunkData.size())
+				{
+					decodedChunk = SIZE_MAX;
+					return false;
+				}
+
+				frame.entities = reinterpret_cast<const ReplayEntityState*>(
+					chunkData.data() + sizeof(ReplaySnapshotHeader));
+				frame.inputs = chunkData.data() + sizeof(ReplaySnapshotHeader) + entitiesSize;
+				frame.inputCount = static_cast<std::uint32_t>(tick - chunk.firstTick + 1);
+
+				return true;
+			}
+	};
+
+	template<class T1, class T2> bool IsIntersecting(T1& A, T2& B) noexcept
+	{
+		return A.right() >= B.left() && A.left() <= B.right() 
+				&& A.bottom() >= B.top() && A.top() <= B.bottom();
+	}
+
+	// Collision tests only read the entities, so they can run on any 
+	// thread. They return `true` when something was hit: reacting to it
+	// (destroying the ship, disabling the bullet...) is up to the caller.
+	bool TestCollisionPlayerBulletWithEnemyShip(const Entity& playerBullet, const Entity& enemyShip) noexcept
+	{	
+		auto& cpPlayerBulletPhysics(playerBullet.GetComponent<Physics>());
+		auto& cpEnemyShipPhysics(enemyShip.GetComponent<Physics>());
+
+		if (!playerBullet.IsActive()) return false;
+		return IsIntersecting(cpPlayerBulletPhysics, cpEnemyShipPhysics);
+	}
+
+	bool TestCollisionEnemyBulletWithPlayerShip(const Entity& enemyBullet, const Entity& playerShip) noexcept
+	{
+		auto& cpEnemyBulletPhysics(enemyBullet.GetComponent<Physics>());
+		auto& cpPlayerShipPhysics(playerShip.GetComponent<Physics>());
+
+		if (!enemyBullet.IsActive()) return false;
+		return IsIntersecting(cpEnemyBulletPhysics, cpPlayerShipPhysics);
+	}
+
+	// The per-entity kernels of the simulation step. They run as a single
+	// `SystemChain`, so the entities are only walked once.
+
+	// Components that keep last tick's state for rendering provide 
+	// `SwapBuffers`, which saves it before the entity is simulated again.
+	// Like every kernel, this one skips inactive entities, so whatever 
+	// enables an entity again must reset both copies (see 
+	// `Transform::Teleport`).
+	template<typename T> struct SwapBuffersKernel
+	{
+		using Reads = Components<>;
+		using Writes = Components<T>;
+		using Gathers = Components<>;
+
+		void operator()(Entity& entity, FrameTime) const
+		{
+			entity.GetComponent<T>().SwapBuffers();
+		}
+	};
+
+	struct MovementKernel
+	{
+		using Reads = Components<Physics>;
+		using Writes = Components<Transform>;
+		using Gathers = Components<>;
+
+		void operator()(Entity& entity, FrameTime frameTime) const
+		{
+			const Entity& readOnly(entity);
+			readOnly.GetComponent<Physics>().Move(entity.GetComponent<Transform>(), frameTime);
+		}
+	};
+
+	// Bullets that leave the screen are disabled, and go back to the pool.
+	struct BulletBoundsKernel
+	{
+		using Reads = Components<Transform, Physics>;
+		using Writes = Components<>;
+		using Gathers = Components<>;
+
+		void operator()(Entity& entity, FrameTime) const
+		{
+			const Entity& readOnly(entity);
+			auto& cPhysics(readOnly.GetComponent<Physics>());
+
+			if (entity.HasGroup(PlayerBullet) && cPhysics.bottom() < Scalar(0))
+				entity.Disable();
+			else if (entity.HasGroup(EnemyBullet) && cPhysics.bottom() > Scalar(windowHeight))
+				entity.Disable();
+		}
+	};
+
+	// Enemy ships of the waves all change direction when any of them 
+	// reaches a border of the window, where the waves take place.
+	struct EnemyBorderKernel
+	{
+		using Reads = Components<Transform, Physics>;
+		using Writes = Components<>;
+		using Gathers = Components<>;
+
+		bool& reached;
+
+		void operator()(Entity& entity, FrameTime) const
+		{
+			if (!entity.HasGroup(OffensiveEnemyShip) && !entity.HasGroup(DefensiveEnemyShip)) return;
+
+			const Entity& readOnly(entity);
+			auto& cPhysics(readOnly.GetComponent<Physics>());
+			if (cPhysics.left() < Scalar(0) || cPhysics.right() > Scalar(windowWidth)) reached = true;
+		}
+	};
+
+	// Streamed ships patrol the rest of the world on their own: each of 
+	// them turns back when it reaches a border of the world.
+	struct StreamedShipBorderKernel
+	{
+		using Reads = Components<Transform>;
+		using Writes = Components<Physics>;
+		using Gathers = Components<>;
+
+		void operator()(Entity& entity, FrameTime) const
+		{
+			if (!entity.HasGroup(StreamedEntity)) return;
+
+			auto& cPhysics(entity.GetComponent<Physics>());
+			if ((cPhysics.left() < Scalar(0) && cPhysics.velocity.x < Scalar(0)) ||
+				(cPhysics.right() > Scalar(worldWidth) && cPhysics.velocity.x > Scalar(0)))
+			{
+				cPhysics.velocity.x = -cPhysics.velocity.x;
+			}
+		}
+	};
+
+	using SimulationSystems = SystemChain<SwapBuffersKernel<Transform>, MovementKernel, 
+		BulletBoundsKernel, EnemyBorderKernel, StreamedShipBorderKernel>;
+	static_assert(SimulationSystems::GetPassCount() == 1, "The simulation kernels should be fused in one pass");
+
+	// Sprites are pushed to the render queue by a kernel, which holds the
+	// queue and the interpolation factor for all of them.
+	struct SpriteKernel
+	{
+		using Reads = Components<Transform, RectangleRenderer>;
+		using Writes = Components<>;
+		using Gathers = Components<>;
+
+		RenderQueue& queue;
+		const FrameInterpolation& interpolation;
+
+		void operator()(Entity& entity, FrameTime) const
+		{
+			const Entity& readOnly(entity);
+			auto& renderer(readOnly.GetComponent<RectangleRenderer>());
+			auto position(readOnly.GetComponent<Transform>().GetInterpolatedPosition(interpolation.alpha));
+
+			queue.Push(renderer.layer, 0, Sprite{ position, renderer.halfSize, renderer.textureRect, renderer.textureID });
+		}
+	};
+
+	using RenderSystems = SystemChain<SpriteKernel>;
+
+	// The bounding boxes of collision targets, as a structure of arrays, 
+	// so that a bullet can be tested against eight of them at once. Boxes
+	// are stored as floats whatever `Scalar` is, and grown a bit: the 
+	// batch test only tells which targets might be hit, and the exact 
+	// test has the last word.
+	class CollisionTargets
+	{
+		private:
+			std::vector<Entity*> entities;
+			std::vector<float> left, right, top, bottom;
+
+		public:
+			void Gather(std::initializer_list<const std::vector<Entity*>*> groups)
+			{
+				entities.clear();
+				left.clear();
+				right.clear();
+				top.clear();
+				bottom.clear();
+
+				for (auto group : groups)
+				{
+					for (auto entity : *group)
+					{
+						auto& physics(entity->GetComponent<Physics>());
+						entities.emplace_back(entity);
+						left.emplace_back(ToFloat(physics.left()) - collisionPrefilterMargin);
+						right.emplace_back(ToFloat(physics.right()) + collisionPrefilterMargin);
+						top.emplace_back(ToFloat(physics.top()) - collisionPrefilterMargin);
+						bottom.emplace_back(ToFloat(physics.bottom()) + collisionPrefilterMargin);
+					}
+				}
+
+				// The last batch is padded with boxes that nothing overlaps.
+				while (left.size() % 8 != 0)
+				{
+					left.emplace_back(std::numeric_limits<float>::max());
+					right.emplace_back(std::numeric_limits<float>::lowest());
+					top.emplace_back(std::numeric_limits<float>::max());
+					bottom.emplace_back(std::numeric_limits<float>::lowest());
+				}
+			}
+
+			// Calls `function(entity)` for every target whose box may 
+			// overlap `box`, in the order they were gathered.
+			template<typename TFunction>
+			void ForEachCandidate(const Physics& box, TFunction&& function) const
+			{
+				auto boxLeft(Floatx8::Broadcast(ToFloat(box.left())));
+				auto boxRight(Floatx8::Broadcast(ToFloat(box.right())));
+				auto boxTop(Floatx8::Broadcast(ToFloat(box.top())));
+				auto boxBottom(Floatx8::Broadcast(ToFloat(box.bottom())));
+
+				for (std::size_t i{0}; i < left.size(); i += 8)
+				{
+					auto overlaps((boxRight >= Floatx8::Load(&left[i])) & (boxLeft <= Floatx8::Load(&right[i]))
+						& (boxBottom >= Floatx8::Load(&top[i])) & (boxTop <= Floatx8::Load(&bottom[i])));
+
+					auto bits(overlaps.ToBits());
+					for (unsigned lane{0}; bits != 0; ++lane, bits >>= 1)
+					{
+						if (bits & 1u) function(*entities[i + lane]);
+					}
+				}
+			}
+	};
+
+	// A bullet touching something, found by the narrowphase.
+	struct Contact
+	{
+		Entity* bullet;
+		Entity* target;
+		EntityID bulletID, targetID;
+	};
+
+	// The narrowphase runs on the worker pool, and every worker records
+	// its contacts in its own buffer, without any locking. `Merge` then 
+	// sorts them all by entity ids: no two contacts have the same pair of
+	// ids, so the order is the same however the work was split, and the 
+	// response pass that follows gives the same result with one thread or 
+	// sixteen.
+	class ContactBuffers
+	{
+		private:
+			std::vector<std::vector<Contact>> buffers;
+			std::vector<Contact> merged;
+
+		public:
+			ContactBuffers(std::size_t workerCount) : buffers(workerCount) { }
+
+			// Can be called from any worker of the pool.
+			void Add(Entity& bullet, Entity& target)
+			{
+				buffers[WorkerPool::GetWorkerIndex()].emplace_back(
+					Contact{ &bullet, &target, bullet.GetID(), target.GetID() });
+			}
+
+			const std::vector<Contact>& Merge()
+			{
+				merged.clear();
+
+				for (auto& buffer : buffers)
+				{
+					merged.insert(std::end(merged), std::begin(buffer), std::end(buffer));
+					buffer.clear();
+				}
+
+				std::sort(std::begin(merged), std::end(merged), [](const Contact& a, const Contact& b)
+				{
+					return std::tie(a.bulletID, a.targetID) < std::tie(b.bulletID, b.targetID);
+				});
+
+				return merged;
+			}
+	};
+
+	struct Game
+	{	
+		// Useful fields
+		FrameTime lastFt{0.f}, currentSlice{0.f}; 
+		bool running{false};
+
+		// Declared first: resources are looked up by entities until the
+		// very end.
+		ResourceRegistry resources;
+
+		WorkerPool workers;
+		TextureCache textures;
+		RenderQueue renderQueue;
+		FrameInterpolation interpolation;
+		Camera camera;
+
+		// Declared before the managers: animated entities unregister 
+		// from it when they are destroyed.
+		AnimationSystem animations;
+		AnimationClipID enemyShipClip{0};
+
+		EntityManager manager;
+		ConcurrentSpawner spawner{ resources };
+		ContactBuffers contacts{ workers.GetWorkerCount() };
+		CollisionTargets enemyShipTargets, playerShipTargets;
+		std::vector<Entity*> activeBullets;
+
+		bool needToChangeEnemyShipDirection{false};
+		SimulationSystems simulationSystems{ SwapBuffersKernel<Transform>{}, MovementKernel{}, 
+			BulletBoundsKernel{}, EnemyBorderKernel{ needToChangeEnemyShipDirection }, StreamedShipBorderKernel{} };
+		RenderSystems renderSystems{ SpriteKernel{ renderQueue, interpolation } };
+
+		ProjectilePool projectiles{ manager };
+
+		// Per-world source of randomness.
+		RandomService random{ randomSeed };
+
+		WaveDirector waveDirector{ *this, "data/waves.txt" };
+		WorldPartition worldPartition{ *this, random };
+		ParticleSystem particles{ random };
+
+		int score{0};
+
+		StatsPublisher statsPublisher;
+		std::uint64_t frameCount{0}, collisionPairCount{0};
+
+		std::uint64_t tickCount{0};
+		ReplayRecorder replay{ recordReplays ? replayFilename : "", replayKeyframeInterval };
+		std::chrono::high_resolution_clock::time_point startTime{ std::chrono::high_resolution_clock::now() };
+
+		FramePacer framePacer{ targetFramePeriod, dropLateFrames };
+		InputLatencyTracker inputLatency;
+		InputSampler inputSampler;
+		GameplayInput gameplayInput;
+
+		// The HUD shows game state and a performance overlay. Performance 
+		// numbers are averaged and refreshed a few times per second.
+		Hud hud;
+		TextRunID hudScore, hudLives, hudWave, hudFps, hudTick, hudEntities;
+		FrameTime hudPerfTime{0.f}, hudPerfTickTime{0.f};
+		int hudPerfFrames{0};
+		sf::Vector2f worldFocus{ windowWidth / 2.f, windowHeight / 2.f };
+
+		// Create a window
+		sf::RenderWindow window{ sf::VideoMode(windowWidth, windowHeight), "Space Invaders - Components" };
+
+		// Creating entities can be done through simple "factory" functions.
+		Entity& CreatePlayerShip()
+		{
+			sf::Vector2f halfSize{ playerShipWidth / 2.f, playerShipHeight / 2.f };
+			auto& entity(manager.AddEntity());
+
+			entity.AddComponent<Transform>(Vec2(sf::Vector2f{ windowWidth / 2.f, windowHeight - 60.f }));
+			entity.AddComponent<Physics>(Vec2(halfSize));
+			entity.AddComponent<RectangleRenderer>(halfSize, "data/playerShip1_blue.png", ShipLayer);
+			entity.AddComponent<PlayerController>();
+
+			entity.AddGroup(SpaceInvadersGroup::PlayerShip);
+
+			return entity;
+		}
+
+		Entity& CreatePlayerBullet()
+		{
+			sf::Vector2f halfSize{ bulletWidth / 2.f, bulletHeight / 2.f };
+			auto& entity(manager.AddEntity());
+
+			entity.AddComponent<Transform>(Vec2(sf::Vector2f{ windowWidth / 2.f, windowHeight / 2.f }));
+			entity.AddComponent<Physics>(Vec2(halfSize));
+			entity.AddComponent<RectangleRenderer>(halfSize, "data/laserBlue03.png", BulletLayer);
+
+			auto& cPhysics(entity.GetComponent<Physics>());
+			cPhysics.velocity = Vec2{ Scalar(0), Scalar(-bulletVelocity) };
+			
+			// Disable Bullet
+			entity.Disable();
+
+			entity.AddGroup(SpaceInvadersGroup::PlayerBullet);
+
+			return entity;
+		}
+
+		void CreateAllPlayerBullets()
+		{
+			for (size_t i = 0; i < maxPlayerBullets; i++)
+			{
+				CreatePlayerBullet();
+			}
+		}
+
+		Entity& CreateEnemyBullet()
+		{
+			sf::Vector2f halfSize{ bulletWidth / 2.f, bulletHeight / 2.f };
+			auto& entity(manager.AddEntity());
+
+			entity.AddComponent<Transform>(Vec2(sf::Vector2f{ windowWidth / 2.f, windowHeight / 2.f }));
+			entity.AddComponent<Physics>(Vec2(halfSize));
+			entity.AddComponent<RectangleRenderer>(halfSize, "data/laserRed03.png", BulletLayer);
+
+			auto& cPhysics(entity.GetComponent<Physics>());
+			cPhysics.velocity = Vec2{ Scalar(0), Scalar(bulletVelocity) };
+
+			// Disable Bullet
+			entity.Disable();
+
+			entity.AddGroup(SpaceInvadersGroup::EnemyBullet);
+
+			return entity;
+		}
+
+		void CreateAllEnemyBullets()
+		{
+			for (size_t i = 0; i < maxEnemyBullets; i++)
+			{
+				CreateEnemyBullet();
+			}
+		}
+
+		// Enemy ships are created in a `target` manager, which is usually 
+		// the staging area of the `WaveDirector`.
+		Entity& CreateOffensiveEnemyShip(EntityManager& target, const sf::Vector2f& position, 
+			std::uint64_t formationSlot, Group group = OffensiveEnemyShip)
+		{
+			sf::Vector2f halfSize{ enemyShipWidth / 2.f, enemyShipHeight / 2.f };
+			auto& entity(target.AddEntity());
+			
+			entity.AddComponent<Transform>(Vec2(position));
+			entity.AddComponent<Physics>(Vec2(halfSize));
+			entity.AddComponent<RectangleRenderer>(halfSize, "data/enemyRed2.png", ShipLayer);
+			entity.AddComponent<Animation>(enemyShipClip);
+			entity.AddComponent<WeaponAIController>(random.GetStream(RandomStreamID::WeaponAI, formationSlot));
+
+			auto& cPhysics(entity.GetComponent<Physics>());
+			cPhysics.velocity = Vec2{ Scalar(enemyShipVelocity), Scalar(0) };
+
+			entity.AddGroup(group);
+
+			return entity;
+		}
+
+		Entity& CreateDefensiveEnemyShip(EntityManager& target, const sf::Vector2f& position, 
+			Group group = DefensiveEnemyShip)
+		{
+			sf::Vector2f halfSize{ enemyShipWidth / 2.f, enemyShipHeight / 2.f };
+			auto& entity(target.AddEntity());
+
+			entity.AddComponent<Transform>(Vec2(position));
+			entity.AddComponent<Physics>(Vec2(halfSize));
+			entity.AddComponent<RectangleRenderer>(halfSize, "data/enemyGreen3.png", ShipLayer);
+			entity.AddComponent<Animation>(enemyShipClip);
+
+			auto& cPhysics(entity.GetComponent<Physics>());
+			cPhysics.velocity = Vec2{ Scalar(enemyShipVelocity), Scalar(0) };
+
+			entity.AddGroup(group);
+
+			return entity;
+		}
+
+		// Rebuilds an entity of the partitioned world from its record.
+		// Streamed ships aren't part of any wave: they only join the 
+		// `StreamedEntity` group, so waves never retire them or wait for
+		// them.
+		Entity& CreateStreamedEntity(EntityManager& target, const EntityRecord& record)
+		{
+			sf::Vector2f position{ record.x, record.y };
+			auto kind(static_cast<EntityKind>(record.kind));
+
+			auto& entity(kind == EntityKind::OffensiveEnemyShip
+				? CreateOffensiveEnemyShip(target, position, record.slot, StreamedEntity)
+				: CreateDefensiveEnemyShip(target, position, StreamedEntity));
+
+			entity.GetComponent<Physics>().velocity = Vec2{ Scalar(record.velocityX), Scalar(record.velocityY) };
+			entity.AddComponent<Streamable>(kind, record.slot);
+
+			return entity;
+		}
+
+		Game()
+		{
+			if (!precisePacing) 
+				window.setFramerateLimit(240);
+
+			resources.Add(textures);
+			resources.Add(renderQueue);
+			resources.Add(interpolation);
+			resources.Add(camera);
+			resources.Add(gameplayInput);
+			resources.Add(animations);
+			resources.Add(projectiles);
+			manager.SetResources(resources);
+			waveDirector.staging.SetResources(resources);
+
+			// Enemy ships wobble, like in the original game, by flipping
+			// their sprite horizontally.
+			enemyShipClip = animations.AddClip(AnimationClip{
+				{ sf::FloatRect{ 0.f, 0.f, 1.f, 1.f }, sf::FloatRect{ 1.f, 0.f, -1.f, 1.f } },
+				{ enemyShipFrameDuration, enemyShipFrameDuration } });
+
+			// Enemy ships are built on the workers: their textures are
+			// loaded beforehand, here on the main thread.
+			textures.Load("data/enemyRed2.png");
+			textures.Load("data/enemyGreen3.png");
+
+			CreatePlayerShip();
+			CreateAllPlayerBullets();
+			CreateAllEnemyBullets();
+			waveDirector.Start();
+
+			hudScore = hud.AddRun(sf::Vector2f{ 10.f, 10.f });
+			hudLives = hud.AddRun(sf::Vector2f{ 300.f, 10.f });
+			hudWave = hud.AddRun(sf::Vector2f{ 600.f, 10.f });
+			hudFps = hud.AddRun(sf::Vector2f{ 10.f, windowHeight - 60.f });
+			hudTick = hud.AddRun(sf::Vector2f{ 10.f, windowHeight - 40.f });
+			hudEntities = hud.AddRun(sf::Vector2f{ 10.f, windowHeight - 20.f });
+		}
+
+		void Run()
+		{
+			running = true;
+
+			while(running)
+			{
+				auto timePoint1(std::chrono::high_resolution_clock::now());
+				
+				window.clear(sf::Color::Black);
+
+				InputPhase(lastFt);
+				UpdatePhase();
+
+				auto timePointUpdate(std::chrono::high_resolution_clock::now());
+				auto tickTime(std::chrono::duration_cast<std::chrono::duration<
+					float, std::milli>>(timePointUpdate - timePoint1).count());
+				UpdateHud(tickTime);
+
+				if (framePacer.ShouldPresent())
+				{
+					DrawPhase();
+
+					if (precisePacing) 
+						framePacer.WaitForDeadline();
+
+					window.display();
+
+					auto presentTime(std::chrono::high_resolution_clock::now());
+					framePacer.OnPresented(presentTime);
+					inputLatency.OnPresented(presentTime);
+				}
+				else
+				{
+					framePacer.OnDropped(std::chrono::high_resolution_clock::now());
+				}
+
+				auto timePoint2(std::chrono::high_resolution_clock::now());
+				auto elapsedTime(timePoint2 - timePoint1);
+				FrameTime ft{ std::chrono::duration_cast<
+					std::chrono::duration<float, std::milli >> (elapsedTime).count() };
+				
+				lastFt = ft;	
+
+				PublishStats(tickTime);
+			}	
+
+			std::ostringstream report;
+			framePacer.PrintReport(report);
+			inputLatency.PrintReport(report);
+
+#ifdef SPACE_INVADERS_VALIDATE_ACCESS
+			AccessValidator::Report(report);
+#endif
+
+			Internal::WriteReport(report.str());
+		}
+
+		void InputPhase(FrameTime frameTime)
+		{
+			sf::Event event;
+			while(window.pollEvent(event)) 
+			{ 
+				if (event.type == sf::Event::Closed)
+				{
+					window.close();
+					break;
+				}
+			}
+
+			if (sf::Keyboard::isKeyPressed(sf::Keyboard::Key::Escape)) 
+				running = false;
+
+			inputSampler.Poll();
+		}
+
+		void UpdatePhase()
+		{
+			// Gameplay input is read by the components during this update, 
+			// so the frame being built reflects the latest sample.
+			inputSampler.Drain([this](const InputSample& sample)
+			{
+				inputLatency.TagSample(sample.time);
+				gameplayInput.keys = sample.keys;
+			});
+
+			// Entities are spawned and freed before the fixed steps, so the
+			// inspector's epoch covers the whole update.
+			WorldInspector::BeginUpdate();
+
+			// Spawning and freeing entities share the same per-frame budget.
+			FrameBudget budget{ spawnBudget };
+			waveDirector.Update(lastFt, budget);
+
+			// The world is streamed around the player ship.
+			auto& playerShip(manager.GetEntitiesByGroup(PlayerShip));
+			if (!playerShip.empty())
+			{
+				worldFocus = sf::Vector2f(playerShip.front()->GetComponent<Transform>().position);
+			}
+			worldPartition.Update(worldFocus, budget);
+
+			manager.CollectGarbage(budget);
+
+			// Particles are cosmetic, so they are updated once per frame
+			// rather than at every fixed step.
+			EmitThrusterParticles(lastFt);
+			particles.Update(lastFt);
+			animations.Update(lastFt);
+
+			currentSlice += lastFt;
+			for(; currentSlice >= ftSlice; currentSlice -= ftSlice)
+			{	
+				// Keyframes are taken before the tick runs, so that they
+				// are the state the recorded input applies to.
+				if (replay.IsKeyframe(tickCount))
+					replay.BeginChunk(tickCount, BuildReplaySnapshot());
+				replay.RecordInput(EncodeReplayInput(gameplayInput));
+				++tickCount;
+
+				manager.Refresh();
+
+				// Buffer swaps, movement and bounds checks first, in a 
+				// single pass, then the components that still have their 
+				// own `Update`.
+				needToChangeEnemyShipDirection = false;
+				simulationSystems.Run(manager, ftStep);
+				manager.Update(ftStep);
+
+				// We get our entities by group...
+				auto& playerShip(manager.GetEntitiesByGroup(PlayerShip));
+				auto& playerBullets(manager.GetEntitiesByGroup(PlayerBullet));
+				auto& offensiveEnemyShips(manager.GetEntitiesByGroup(OffensiveEnemyShip));
+				auto& defensiveEnemyShips(manager.GetEntitiesByGroup(DefensiveEnemyShip));
+				auto& streamedShips(manager.GetEntitiesByGroup(StreamedEntity));
+				auto& enemyBullets(manager.GetEntitiesByGroup(EnemyBullet));
+
+				// The camera moves with the player ship, at the same pace 
+				// as the sprites.
+				camera.Follow(playerShip.empty() ? worldFocus 
+					: sf::Vector2f(playerShip.front()->GetComponent<Transform>().position));
+
+				collisionPairCount += playerBullets.size() 
+					* (offensiveEnemyShips.size() + defensiveEnemyShips.size() + streamedShips.size())
+					+ enemyBullets.size() * playerShip.size();
+
+				// ...perform collision tests on them, and respond to the hits.
+				RespondToContacts(FindContacts());
+
+				if (needToChangeEnemyShipDirection)
+				{
+					ChangeEnemiesShipDirection();
+				}
+			}
+
+			WorldInspector::EndUpdate();
+		}
+
+		// Every bullet is tested against its targets on a worker; nothing 
+		// is changed until all of them are done.
+		const std::vector<Contact>& FindContacts()
+		{
+			auto& playerShip(manager.GetEntitiesByGroup(PlayerShip));
+			auto& offensiveEnemyShips(manager.GetEntitiesByGroup(OffensiveEnemyShip));
+			auto& defensiveEnemyShips(manager.GetEntitiesByGroup(DefensiveEnemyShip));
+			auto& streamedShips(manager.GetEntitiesByGroup(StreamedEntity));
+
+			// Most of the bullet pool is usually inactive: the bitsets give
+			// us the few bullets that are flying without looking at the
+			// others.
+			activeBullets.clear();
+			manager.ForEachActiveInGroup(PlayerBullet, [this](Entity& entity) { activeBullets.emplace_back(&entity); });
+			auto playerBulletCount(activeBullets.size());
+			manager.ForEachActiveInGroup(EnemyBullet, [this](Entity& entity) { activeBullets.emplace_back(&entity); });
+
+			enemyShipTargets.Gather({ &defensiveEnemyShips, &offensiveEnemyShips, &streamedShips });
+			playerShipTargets.Gather({ &playerShip });
+
+			workers.ParallelFor(activeBullets.size(), bulletsPerCollisionJob,
+				[&](std::size_t first, std::size_t last)
+				{
+#ifdef SPACE_INVADERS_VALIDATE_ACCESS
+					AccessValidator::Scope scope{ "Narrowphase", 
+						Internal::GetComponentMask(Components<Transform, Physics>{}), ComponentBitset{} };
+#endif
+
+					for (auto i(first); i < last; ++i)
+					{
+						if (i < playerBulletCount)
+						{
+							const Entity& pB(*activeBullets[i]);
+
+							enemyShipTargets.ForEachCandidate(pB.GetComponent<Physics>(), [&](Entity& eS)
+							{
+								if (TestCollisionPlayerBulletWithEnemyShip(pB, eS)) contacts.Add(*activeBullets[i], eS);
+							});
+						}
+						else
+						{
+							const Entity& eB(*activeBullets[i]);
+
+							playerShipTargets.ForEachCandidate(eB.GetComponent<Physics>(), [&](Entity& pS)
+							{
+								if (TestCollisionEnemyBulletWithPlayerShip(eB, pS)) contacts.Add(*activeBullets[i], pS);
+							});
+						}
+					}
+				});
+
+			return contacts.Merge();
+		}
+
+		// Contacts come sorted by ids, so the response is always applied in
+		// the same order.
+		void RespondToContacts(const std::vector<Contact>& sortedContacts)
+		{
+			for (auto& contact : sortedContacts)
+			{
+				// A bullet stops at the first thing it hits, and a ship is
+				// only destroyed (and scored) once.
+				if (!contact.bullet->IsActive()) continue;
+				if (!contact.target->IsAlive()) continue;
+
+				contact.bullet->Disable();
+				contact.target->Destroy();
+
+				if (contact.target->HasGroup(PlayerShip))
+				{
+					EmitExplosion(*contact.target, sf::Color::Cyan);
+				}
+				else if (IsDefensiveEnemyShip(*contact.target))
+				{
+					EmitExplosion(*contact.target, sf::Color::Green);
+					score += defensiveEnemyShipScore;
+				}
+				else
+				{
+					EmitExplosion(*contact.target, sf::Color::Red);
+					score += offensiveEnemyShipScore;
+				}
+			}
+		}
+
+		static bool IsDefensiveEnemyShip(const Entity& entity)
+		{
+			if (entity.HasGroup(StreamedEntity))
+				return entity.GetComponent<Streamable>().kind == EntityKind::DefensiveEnemyShip;
+
+			return entity.HasGroup(DefensiveEnemyShip);
+		}
+
+		void ChangeEnemiesShipDirection()
+		{
+			auto& offensiveEnemyShips(manager.GetEntitiesByGroup(OffensiveEnemyShip));
+			auto& defensiveEnemyShips(manager.GetEntitiesByGroup(DefensiveEnemyShip));
+
+			for (auto& deS : defensiveEnemyShips)
+			{
+				auto& cPhysics = deS->GetComponent<Physics>();
+
+				cPhysics.velocity.x = -cPhysics.velocity.x;
+
+				// Move down
+				cPhysics.SetY(cPhysics.y() + Scalar(5));
+			}
+
+			for (auto& oeS : offensiveEnemyShips)
+			{
+				auto& cPhysics = oeS->GetComponent<Physics>();
+
+				cPhysics.velocity.x = -cPhysics.velocity.x;
+
+				// Move down
+				cPhysics.SetY(cPhysics.y() + Scalar(5));
+			}
+		}
+
+		void EmitExplosion(const Entity& entity, const sf::Color& color)
+		{
+			particles.EmitBurst(sf::Vector2f(entity.GetComponent<Transform>().position), 
+				explosionParticles, explosionSpeed, explosionLifetime, color);
+		}
+
+		void EmitThrusterParticles(FrameTime frameTime)
+		{
+			for (auto& pS : manager.GetEntitiesByGroup(PlayerShip))
+			{
+				if (!pS->IsAlive()) continue;
+
+				sf::Vector2f position(pS->GetComponent<Transform>().position);
+				position.y += playerShipHeight / 2.f;
+
+				for (int i{0}; i < static_cast<int>(frameTime * thrusterParticlesPerMs + 1.f); ++i)
+				{
+					particles.EmitJet(position, sf::Vector2f{ 0.f, thrusterSpeed }, 
+						thrusterSpread, thrusterLifetime, sf::Color{ 255, 180, 60 });
+				}
+			}
+		}
+
+		void PublishStats(FrameTime tickTime)
+		{
+			StatsSnapshot snapshot{};
+			snapshot.frame = ++frameCount;
+			snapshot.frameTime = lastFt;
+			snapshot.tickTime = tickTime;
+			snapshot.entityCount = static_cast<std::uint32_t>(manager.GetEntityCount());
+			snapshot.graveyardCount = static_cast<std::uint32_t>(manager.GetGraveyardCount());
+			snapshot.particleCount = static_cast<std::uint32_t>(particles.GetCount());
+
+			for (std::size_t i{0}; i < maxGroups; ++i)
+				snapshot.groupCounts[i] = static_cast<std::uint32_t>(manager.GetEntitiesByGroup(i).size());
+
+			snapshot.activePlayerBullets = static_cast<std::uint32_t>(manager.CountActiveInGroup(PlayerBullet));
+			snapshot.activeEnemyBullets = static_cast<std::uint32_t>(manager.CountActiveInGroup(EnemyBullet));
+
+			snapshot.createdEntityCount = manager.GetCreatedEntityCount() 
+				+ waveDirector.staging.GetCreatedEntityCount() + spawner.GetCreatedEntityCount();
+			snapshot.collisionPairCount = collisionPairCount;
+			snapshot.inspectorOverflowCount = WorldInspector::GetOverflowCount();
+			snapshot.timestamp = static_cast<std::uint64_t>(std::chrono::duration_cast<
+				std::chrono::milliseconds>(std::chrono::high_resolution_clock::now() - startTime).count());
+
+			statsPublisher.Publish(snapshot);
+		}
+
+		std::vector<std::uint8_t> BuildReplaySnapshot() const
+		{
+			ReplaySnapshotHeader header{ tickCount, score, 0 };
+			std::vector<std::uint8_t> payload(sizeof(ReplaySnapshotHeader));
+
+			manager.ForEachWith<Transform>([&](const Entity& entity)
+			{
+				ReplayEntityState state{};
+				for (std::size_t i{0}; i < maxGroups; ++i)
+				{
+					if (entity.HasGroup(i)) state.groups |= 1u << i;
+				}
+
+				if (entity.IsAlive()) state.flags |= ReplayEntityState::Alive;
+				if (entity.IsActive()) state.flags |= ReplayEntityState::Active;
+
+				auto& position(entity.GetComponent<Transform>().position);
+				state.x = ToFloat(position.x);
+				state.y = ToFloat(position.y);
+
+				if (entity.HasComponent<Physics>())
+				{
+					auto& velocity(entity.GetComponent<Physics>().velocity);
+					state.velocityX = ToFloat(velocity.x);
+					state.velocityY = ToFloat(velocity.y);
+				}
+
+				auto bytes(reinterpret_cast<const std::uint8_t*>(&state));
+				payload.insert(std::end(payload), bytes, bytes + sizeof(ReplayEntityState));
+				++header.entityCount;
+			});
+
+			std::memcpy(payload.data(), &header, sizeof(ReplaySnapshotHeader));
+			return payload;
+		}
+
+		static std::uint8_t EncodeReplayInput(const GameplayInput& input) noexcept
+		{
+			return static_cast<std::uint8_t>((input.keys[GameplayInput::Left] ? ReplayLeft : 0) 
+				| (input.keys[GameplayInput::Right] ? ReplayRight : 0) 
+				| (input.keys[GameplayInput::Fire] ? ReplayFire : 0));
+		}
+
+		void UpdateHud(FrameTime tickTime)
+		{
+			auto lives(std::count_if(std::begin(manager.GetEntitiesByGroup(PlayerShip)), 
+				std::end(manager.GetEntitiesByGroup(PlayerShip)), 
+				[](Entity* entity) { return entity->IsAlive(); }));
+
+			// Unchanged texts are not rebuilt.
+			hud.SetText(hudScore, "SCORE " + std::to_string(score));
+			hud.SetText(hudLives, "LIVES " + std::to_string(lives));
+			hud.SetText(hudWave, "WAVE " + std::to_string(waveDirector.waveNumber));
+
+			hudPerfTime += lastFt;
+			hudPerfTickTime += tickTime;
+			++hudPerfFrames;
 
-		void UsePlayerShipWeapon(const sf::Vector2f& bulletSpawnLocation, int& currentPlayerBullet);
+			if (hudPerfTime < hudPerfRefreshPeriod) return;
+
+			auto fps(static_cast<int>(hudPerfFrames * 1000.f / hudPerfTime));
+			auto tickMicroseconds(static_cast<int>(hudPerfTickTime * 1000.f / hudPerfFrames));
+
+			hud.SetText(hudFps, "FPS " + std::to_string(fps));
+			hud.SetText(hudTick, "TICK " + std::to_string(tickMicroseconds / 1000) + "." 
+				+ std::to_string(tickMicroseconds % 1000 / 100) + " MS");
+			hud.SetText(hudEntities, "ENTITIES " + std::to_string(manager.GetEntityCount()));
+
+			hudPerfTime = hudPerfTickTime = 0.f;
+			hudPerfFrames = 0;
+		}
+
+		void DrawPhase() 
+		{ 
+			interpolation.alpha = interpolateRendering ? currentSlice / ftSlice : 1.f;
+			window.setView(camera.GetView(interpolation.alpha));
+
+			// Sprites only fill the render queue...
+			renderSystems.Run(manager, 0.f);
+
+			// ...which is then sorted and drawn in batches.
+			renderQueue.Flush(window, textures, workers);
+
+			particles.Draw(window);
+
+			// The HUD doesn't scroll with the world.
+			window.setView(window.getDefaultView());
+			hud.Draw(window);
+		}
 	};
 
-	// We'll use groups to keep track of our entities.
-	enum SpaceInvadersGroup : std::size_t
+	void RectangleRenderer::Initialize()
+	{	
+		transform = &entity->GetComponent<Transform>();
+
+		auto& textures(entity->GetResource<TextureCache>());
+		textureID = textures.Load(textureFilename);
+		textureSize = sf::Vector2f(textures.Get(textureID).getSize());
+		SetTextureRect(sf::FloatRect{ 0.f, 0.f, 1.f, 1.f });
+	}
+
+	void WaveDirector::Start()
 	{
-		PlayerShip,
-		OffensiveEnemyShip,
-		PlayerBullet,
-		EnemyBullet,
-		DefensiveEnemyShip
-	};
+		for (auto group : { OffensiveEnemyShip, DefensiveEnemyShip })
+		{
+			game.manager.OnGroupJoin(group, [this](const std::vector<Entity*>& entities)
+			{
+				activeShipCount += static_cast<int>(entities.size());
+			});
 
-	struct WeaponAIController : Component
+			game.manager.OnGroupLeave(group, [this](const std::vector<Entity*>& entities)
+			{
+				activeShipCount -= static_cast<int>(entities.size());
+			});
+		}
+
+		RequestNextFormation();
+		BuildStagedWave(nullptr);
+		ActivateStagedWave();
+		RequestNextFormation();
+	}
+
+	void WaveDirector::Update(FrameTime frameTime, const FrameBudget& budget)
 	{
-		Transform* transform{ nullptr };
-		EntityManager* manager{ nullptr };
-		int currentEnemyBullet;
+		activeWaveTime += frameTime;
 
-		float nextFireTimePoint = 0.f;
-		float accumulatedTime = 0.f;
+		if (hasStagedFormation && !IsStagedWaveReady())
+		{
+			BuildStagedWave(&budget);
+		}
+
+		if (IsActiveWaveOver() && IsStagedWaveReady())
+		{
+			RetireActiveWave();
+			ActivateStagedWave();
+			RequestNextFormation();
+		}
+	}
 
-		WeaponAIController(EntityManager* manager, int& currentEnemyBullet)
-			: manager{ manager }, currentEnemyBullet{currentEnemyBullet}   {}
+	void WaveDirector::RequestNextFormation()
+	{
+		stagedSlot = 0;
+		hasStagedFormation = formations.Next(stagedFormation);
 
-		void Initialize() override
+		if (hasStagedFormation)
 		{
-			// A requirement for `WeaponAIController` is `Transform`.
-			transform = &entity->GetComponent<Transform>();
+			staging.Reserve(stagedFormation.GetSlotCount());
+		}
+	}
 
-			GetNextFireTimePoint();
+	// Ships are built on the workers, a batch at a time, and published to
+	// `staging` once the whole batch is done.
+	void WaveDirector::BuildStagedWave(const FrameBudget* budget)
+	{
+		while (stagedSlot < stagedFormation.GetSlotCount())
+		{
+			if (budget != nullptr && budget->IsExhausted()) return;
+
+			auto firstSlot(stagedSlot);
+			auto batchSize(std::min(static_cast<std::size_t>(stagedFormation.GetSlotCount() - stagedSlot), 
+				enemyShipsPerBuildBatch));
+
+			game.spawner.Spawn(game.workers, batchSize, enemyShipsPerBuildJob, 
+				[this, firstSlot](EntityManager& target, std::size_t i)
+				{
+					BuildShip(target, firstSlot + static_cast<int>(i));
+				});
+			game.spawner.Publish(staging);
+
+			stagedSlot += static_cast<int>(batchSize);
 		}
+	}
 
-		void Update(float frameTime) override
+	// Runs on the workers.
+	Entity& WaveDirector::BuildShip(EntityManager& target, int slot) const
+	{
+		int iX{ slot / stagedFormation.rows };
+		int iY{ slot % stagedFormation.rows };
+
+		sf::Vector2f position{
+			(iX + 1) * (enemyShipWidth + 5) + 22,
+			(iY + 1) * (enemyShipHeight + 5) };
+
+		// Random streams are keyed by wave and slot, so fire patterns
+		// don't depend on the order in which ships are built.
+		auto formationSlot((static_cast<std::uint64_t>(waveNumber + 1) << 32) | 
+			static_cast<std::uint64_t>(slot));
+
+		auto& entity(stagedFormation.rowPattern[iY % stagedFormation.rowPattern.size()] == 'O'
+			? game.CreateOffensiveEnemyShip(target, position, formationSlot)
+			: game.CreateDefensiveEnemyShip(target, position));
+
+		entity.GetComponent<Physics>().velocity = Vec2{ Scalar(stagedFormation.velocity), Scalar(0) };
+
+		return entity;
+	}
+
+	bool WaveDirector::IsStagedWaveReady() const noexcept
+	{
+		return hasStagedFormation && stagedSlot == stagedFormation.GetSlotCount();
+	}
+
+	void WaveDirector::ActivateStagedWave()
+	{
+		game.manager.Adopt(staging);
+
+		// Refreshing delivers the notifications right away, so the new
+		// ships are counted before the next wave check.
+		game.manager.Refresh();
+
+		activeFormation = stagedFormation;
+		activeWaveTime = 0.f;
+		++waveNumber;
+		hasStagedFormation = false;
+	}
+
+	void WaveDirector::RetireActiveWave()
+	{
+		// Destroying only flags the entities: they'll be moved to the 
+		// graveyard on refresh and freed within the per-frame budget.
+		for (auto group : { OffensiveEnemyShip, DefensiveEnemyShip })
 		{
-			accumulatedTime += frameTime;
-		
-			if (accumulatedTime > nextFireTimePoint)
+			game.manager.Destroy(game.manager.GetEntitiesByGroup(group));
+		}
+	}
+
+	bool WaveDirector::IsActiveWaveOver() const
+	{
+		if (activeFormation.duration > 0.f && activeWaveTime >= activeFormation.duration)
+			return true;
+
+		// Ships destroyed since the last refresh are still counted.
+		return activeShipCount == 0;
+	}
+
+	namespace Internal
+	{
+		// These run on worker threads: they only touch the file system
+		// and the data that was passed to them.
+		// A full queue means the simulation is behind: back off and retry.
+		void PushLoadedRecord(LoadedRecordQueue& output, const EntityRecord& record)
+		{
+			while (!output.TryPush(record)) std::this_thread::yield();
+		}
+
+		void LoadCellRecords(std::string filename, std::shared_future<void> pendingWrite, 
+			RandomStream stream, sf::Vector2f cellOrigin, LoadedRecordQueue& output)
+		{
+			if (pendingWrite.valid()) pendingWrite.wait();
+
+			std::vector<EntityRecord> records;
+			std::ifstream file{ filename, std::ios::binary | std::ios::ate };
+
+			if (!file)
 			{
-				UseEnemyShipWeapon(transform->position, currentEnemyBullet);
+				// Never visited cells are generated from the cell's own 
+				// stream. The cells of the first screen, where the waves 
+				// take place, are left empty.
+				if (cellOrigin.x < windowWidth && cellOrigin.y < windowHeight) return;
 
-				GetNextFireTimePoint();
+				for (int i{0}; i < worldGenerationDensity; ++i)
+				{
+					EntityRecord record{};
+					record.kind = static_cast<std::uint8_t>(stream.NextInt(0, 1));
+					record.slot = static_cast<std::uint32_t>(stream.Next());
+					record.x = cellOrigin.x + stream.NextInt(0, static_cast<int>(worldCellSize) - 1);
+					record.y = cellOrigin.y + stream.NextInt(0, static_cast<int>(worldCellSize) - 1);
+					record.velocityX = stream.NextInt(0, 1) == 0 ? -enemyShipVelocity : enemyShipVelocity;
+					PushLoadedRecord(output, record);
+				}
 
-				// Reset timer
-				accumulatedTime = 0.f;
+				return;
 			}
+
+			auto size(static_cast<std::size_t>(file.tellg()));
+			records.resize(size / sizeof(EntityRecord));
+			file.seekg(0);
+			file.read(reinterpret_cast<char*>(records.data()), records.size() * sizeof(EntityRecord));
+			file.close();
+
+			// The entities now live in memory: the file will be written again
+			// when they get unloaded.
+			std::remove(filename.c_str());
+
+			for (auto& record : records) PushLoadedRecord(output, record);
 		}
 
-		void GetNextFireTimePoint()
+		void AppendCellRecords(std::string filename, std::shared_future<void> previousWrite, 
+			std::vector<EntityRecord> records)
 		{
-			nextFireTimePoint = static_cast<float>((1 + (rndEngine() % 15)) * 1000); // In milliseconds
+			if (previousWrite.valid()) previousWrite.wait();
+
+			std::ofstream file{ filename, std::ios::binary | std::ios::app };
+			file.write(reinterpret_cast<const char*>(records.data()), records.size() * sizeof(EntityRecord));
 		}
+	}
 
-		void UseEnemyShipWeapon(const sf::Vector2f& bulletSpawnLocation, int& currentEnemyBullet);
-	};
+	WorldPartition::WorldPartition(Game& game, const RandomService& random)
+		: game(game), generationStream{ random.GetStream(RandomStreamID::WorldGeneration) } 
+	{
+		// Every world starts from scratch: cells saved by a previous 
+		// session would otherwise be loaded back.
+		for (int cellX{0}; cellX <= GetLastCellX(); ++cellX)
+		{
+			for (int cellY{0}; cellY <= GetLastCellY(); ++cellY)
+			{
+				std::remove(GetCellFilename(cellX, cellY).c_str());
+			}
+		}
+	}
 
-	template<class T1, class T2> bool IsIntersecting(T1& A, T2& B) noexcept
+	WorldPartition::~WorldPartition()
 	{
-		return A.right() >= B.left() && A.left() <= B.right() 
-				&& A.bottom() >= B.top() && A.top() <= B.bottom();
+		// Loaders blocked on a full queue would never finish: keep the 
+		// queue moving, and throw the records away.
+		std::vector<EntityRecord> discarded;
+
+		for (auto& pair : cells)
+		{
+			auto& cell(pair.second);
+			if (!cell.pendingLoad.valid()) continue;
+
+			while (cell.pendingLoad.wait_for(std::chrono::milliseconds(1)) != std::future_status::ready)
+			{
+				loadedRecords.PopBatch(std::back_inserter(discarded), worldLoadQueueCapacity);
+				discarded.clear();
+			}
+		}
 	}
 
-	void TestCollisionPlayerBulletWithEnemyShip(Entity& playerBullet, Entity& enemyShip) noexcept
-	{	
-		auto& cpPlayerBulletPhysics(playerBullet.GetComponent<Physics>());
-		auto& cpEnemyShipPhysics(enemyShip.GetComponent<Physics>());
+	void WorldPartition::Update(const sf::Vector2f& focus, const FrameBudget& budget)
+	{
+		UpdateActiveRange(focus);
+		StartLoadingActiveCells();
+		DrainLoadedRecords();
+		UnloadDistantEntities();
+		SpawnPendingRecords(budget);
+	}
+
+	std::size_t WorldPartition::GetLoadedCellCount() const noexcept
+	{
+		return static_cast<std::size_t>(std::count_if(std::begin(cells), std::end(cells),
+			[](const std::pair<const std::uint64_t, Cell>& cell) { return cell.second.loaded; }));
+	}
+
+	void WorldPartition::UpdateActiveRange(const sf::Vector2f& focus)
+	{
+		minCellX = std::max(0, static_cast<int>(std::floor((focus.x - worldActiveRadius) / worldCellSize)));
+		maxCellX = std::min(GetLastCellX(), static_cast<int>(std::floor((focus.x + worldActiveRadius) / worldCellSize)));
+		minCellY = std::max(0, static_cast<int>(std::floor((focus.y - worldActiveRadius) / worldCellSize)));
+		maxCellY = std::min(GetLastCellY(), static_cast<int>(std::floor((focus.y + worldActiveRadius) / worldCellSize)));
+	}
+
+	void WorldPartition::StartLoadingActiveCells()
+	{
+		for (int cellX{ minCellX }; cellX <= maxCellX; ++cellX)
+		{
+			for (int cellY{ minCellY }; cellY <= maxCellY; ++cellY)
+			{
+				auto& cell(cells[GetCellKey(cellX, cellY)]);
+				if (cell.loaded || cell.pendingLoad.valid()) continue;
+
+				auto stream(generationStream);
+				stream.key ^= Internal::MixBits(GetCellKey(cellX, cellY));
+
+				cell.pendingLoad = std::async(std::launch::async, Internal::LoadCellRecords,
+					GetCellFilename(cellX, cellY), cell.pendingWrite, stream,
+					sf::Vector2f{ cellX * worldCellSize, cellY * worldCellSize }, std::ref(loadedRecords));
+			}
+		}
+	}
+
+	void WorldPartition::DrainLoadedRecords()
+	{
+		// One batch per frame, at most a full queue: loaders that are 
+		// still pushing will be picked up next frame.
+		loadedRecords.PopBatch(std::back_inserter(pendingSpawns), worldLoadQueueCapacity);
+
+		for (auto& pair : cells)
+		{
+			auto& cell(pair.second);
+			if (!cell.pendingLoad.valid()) continue;
+
+			if (cell.pendingLoad.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+				continue;
+
+			cell.pendingLoad.get();
+			cell.loaded = true;
+		}
+	}
+
+	void WorldPartition::UnloadDistantEntities()
+	{
+		std::unordered_map<std::uint64_t, std::vector<EntityRecord>> unloadedRecords;
+
+		for (auto& e : game.manager.GetEntitiesByGroup(StreamedEntity))
+		{
+			if (!e->IsAlive()) continue;
+
+			auto& transform(e->GetComponent<Transform>());
+			auto cellX(GetCellX(transform.x()));
+			auto cellY(GetCellY(transform.y()));
+
+			if (IsCellActive(cellX, cellY)) continue;
+
+			// A cell that is still being read can't be appended to yet:
+			// we'll try again next frame.
+			auto key(GetCellKey(cellX, cellY));
+			auto& cell(cells[key]);
+			if (cell.pendingLoad.valid()) continue;
+
+			unloadedRecords[key].emplace_back(e->GetComponent<Streamable>().ToRecord());
+			e->Destroy();
+		}
+
+		// A cell that goes out of range is always written, even when all
+		// its entities were killed: the empty file tells the loader not to
+		// generate the cell again.
+		for (auto& pair : cells)
+		{
+			auto cellX(static_cast<int>(pair.first >> 32));
+			auto cellY(static_cast<int>(static_cast<std::uint32_t>(pair.first)));
+
+			if (pair.second.loaded && !IsCellActive(cellX, cellY)) unloadedRecords[pair.first];
+		}
+
+		for (auto& pair : unloadedRecords)
+		{
+			auto cellX(static_cast<int>(pair.first >> 32));
+			auto cellY(static_cast<int>(static_cast<std::uint32_t>(pair.first)));
+			auto& cell(cells[pair.first]);
+
+			cell.pendingWrite = std::async(std::launch::async, Internal::AppendCellRecords,
+				GetCellFilename(cellX, cellY), cell.pendingWrite, std::move(pair.second)).share();
+		}
+
+		for (auto& pair : cells)
+		{
+			auto cellX(static_cast<int>(pair.first >> 32));
+			auto cellY(static_cast<int>(static_cast<std::uint32_t>(pair.first)));
+
+			if (!IsCellActive(cellX, cellY)) pair.second.loaded = false;
+		}
+	}
+
+	void WorldPartition::SpawnPendingRecords(const FrameBudget& budget)
+	{
+		while (!pendingSpawns.empty() && !budget.IsExhausted())
+		{
+			game.CreateStreamedEntity(game.manager, pendingSpawns.back());
+			pendingSpawns.pop_back();
+		}
+	}
+
+	void PlayerController::UsePlayerShipWeapon(const Vec2& bulletSpawnLocation)
+	{
+		auto& playerBullet(entity->GetResource<ProjectilePool>().NextPlayerBullet());
+
+		auto& cPlayerBulletTransform(playerBullet.GetComponent<Transform>());
+
+		cPlayerBulletTransform.Teleport(Vec2{ bulletSpawnLocation.x, bulletSpawnLocation.y - Scalar(45) });
+
+		playerBullet.Enable();
+	}
+
+	void WeaponAIController::UseEnemyShipWeapon(const Vec2& bulletSpawnLocation)	
+	{
+		auto& enemyBullet(entity->GetResource<ProjectilePool>().NextEnemyBullet());
+
+		auto& cEnemyBulletTransform(enemyBullet.GetComponent<Transform>());
+
+		cEnemyBulletTransform.Teleport(Vec2{ bulletSpawnLocation.x, bulletSpawnLocation.y + Scalar(45) });
+
+		enemyBullet.Enable();
+	}
+}
+
+namespace SpaceInvaders
+{
+	// `--stats` turns the executable into a small monitoring tool, which 
+	// tails the stats published by a running game.
+	int TailStats()
+	{
+		SharedMemory memory;
+		if (!memory.Open(statsSegmentName, sizeof(StatsBlock)))
+		{
+			std::cerr << "No running game found\n";
+			return 1;
+		}
+
+		auto& block(*static_cast<const StatsBlock*>(memory.GetData()));
+		if (block.magic != StatsBlock::expectedMagic || block.version != StatsBlock::expectedVersion)
+		{
+			std::cerr << "Unknown stats format\n";
+			return 1;
+		}
+
+		auto previous(block.Read());
+
+		while (true)
+		{
+			std::this_thread::sleep_for(std::chrono::milliseconds(500));
+
+			auto current(block.Read());
+			if (current.frame == previous.frame) continue;
+
+			auto seconds((current.timestamp - previous.timestamp) / 1000.0);
+			if (seconds <= 0.0) continue;
+
+			std::cout << "frame " << current.frame
+				<< " | tick " << current.tickTime << " ms"
+				<< " | frame " << current.frameTime << " ms"
+				<< " | entities " << current.entityCount 
+				<< " (+" << current.graveyardCount << " dead)"
+				<< " | bullets " << current.activePlayerBullets << "/" << maxPlayerBullets 
+				<< " " << current.activeEnemyBullets << "/" << maxEnemyBullets
+				<< " | particles " << current.particleCount
+				<< " | spawns/s " << (current.createdEntityCount - previous.createdEntityCount) / seconds
+				<< " | pairs/s " << (current.collisionPairCount - previous.collisionPairCount) / seconds;
+
+			if (current.inspectorOverflowCount > 0)
+				std::cout << " | not in the shared world " << current.inspectorOverflowCount;
+
+			std::cout << "\n";
+
+			previous = current;
+		}
+	}
+}
+
+namespace SpaceInvaders
+{
+	// `--inspect` reads the world of a game started with `--shared-world`
+	// directly from its shared memory segment. Nothing is copied by the 
+	// game: this process walks the live slots using the type table.
+	int InspectWorld()
+	{
+		SharedMemory headerMemory;
+		if (!headerMemory.Open(worldSegmentName, sizeof(InspectorHeader)))
+		{
+			std::cerr << "No game with a shared world found\n";
+			return 1;
+		}
+
+		auto& probe(*static_cast<const InspectorHeader*>(headerMemory.GetData()));
+		if (probe.magic != InspectorHeader::expectedMagic || probe.version != InspectorHeader::expectedVersion)
+		{
+			std::cerr << "Unknown world format\n";
+			return 1;
+		}
+
+		SharedMemory memory;
+		if (!memory.Open(worldSegmentName, static_cast<std::size_t>(probe.segmentSize))) return 1;
+
+		auto base(static_cast<const char*>(memory.GetData()));
+		auto& header(*reinterpret_cast<const InspectorHeader*>(base));
+
+		auto findField([](const InspectorTypeInfo& type, const char* name) -> const InspectorField*
+		{
+			for (std::uint32_t i{0}; i < type.fieldCount; ++i)
+			{
+				if (std::strcmp(type.fields[i].name, name) == 0) return &type.fields[i];
+			}
+			return nullptr;
+		});
+
+		while (true)
+		{
+			std::this_thread::sleep_for(std::chrono::milliseconds(500));
 
-		if (!cpPlayerBulletPhysics.entity->IsActive()) return;
-		if(!IsIntersecting(cpPlayerBulletPhysics, cpEnemyShipPhysics)) return;
-		
-		// Destroy Enemy Ship 
-		enemyShip.Destroy();
-		// Disable Player Bullet  
-		playerBullet.Disable();
-	}
+			std::ostringstream report;
+			auto epoch(header.epoch.load(std::memory_order_acquire));
+			if (epoch & 1u) continue;
 
-	void TestCollisionEnemyBulletWithPlayerShip(Entity& enemyBullet, Entity& playerShip) noexcept
-	{
-		auto& cpEnemyBulletPhysics(enemyBullet.GetComponent<Physics>());
-		auto& cpPlayerShipPhysics(playerShip.GetComponent<Physics>());
+			for (std::uint32_t t{0}; t < header.typeCount; ++t)
+			{
+				auto& type(header.types[t]);
+				auto occupancy(reinterpret_cast<const std::uint8_t*>(base + type.occupancyOffset));
+				auto slots(base + type.slotsOffset);
 
-		if (!cpEnemyBulletPhysics.entity->IsActive()) return;
-		if (!IsIntersecting(cpEnemyBulletPhysics, cpPlayerShipPhysics)) return;
+				auto alive(findField(type, "alive"));
+				auto groups(findField(type, "groups"));
+				auto position(findField(type, "position"));
 
-		// Destroy Player Ship   
-		playerShip.Destroy();
-		// Disable Enemy Bullet 
-		enemyBullet.Disable();
-	}
+				std::size_t liveCount{0};
+				std::array<std::size_t, maxGroups> groupCounts{};
+				sf::Vector2f minPosition{ 1e9f, 1e9f }, maxPosition{ -1e9f, -1e9f };
 
-	struct Game
-	{	
-		// Useful fields
-		FrameTime lastFt{0.f}, currentSlice{0.f}; 
-		bool running{false};
-		EntityManager manager;
+				for (std::uint32_t slot{0}; slot < type.slotCount; ++slot)
+				{
+					if (occupancy[slot] == 0) continue;
 
-		int currentPlayerBullet = 0;
-		int currentEnemyBullet = 0;
+					auto object(slots + static_cast<std::size_t>(slot) * type.slotSize);
+					if (alive != nullptr && *reinterpret_cast<const bool*>(object + alive->offset) == false) 
+						continue;
 
-		// Create a window
-		sf::RenderWindow window{ sf::VideoMode(windowWidth, windowHeight), "Space Invaders - Components" };
+					++liveCount;
 
-		// Creating entities can be done through simple "factory" functions.
-		Entity& CreatePlayerShip()
-		{
-			sf::Vector2f halfSize{ playerShipWidth / 2.f, playerShipHeight / 2.f };
-			auto& entity(manager.AddEntity());
+					if (groups != nullptr)
+					{
+						auto bits(*reinterpret_cast<const std::uint32_t*>(object + groups->offset));
+						for (std::size_t g{0}; g < maxGroups; ++g)
+							groupCounts[g] += (bits >> g) & 1u;
+					}
 
-			entity.AddComponent<Transform>(sf::Vector2f{ windowWidth / 2.f, windowHeight - 60.f });
-			entity.AddComponent<Physics>(halfSize);
-			entity.AddComponent<RectangleRenderer>(this, halfSize, "data/playerShip1_blue.png");
-			entity.AddComponent<PlayerController>(this, &manager, currentPlayerBullet);
+					if (position != nullptr)
+					{
+						sf::Vector2f value;
+						if (static_cast<InspectedFieldType>(position->type) == InspectedFieldType::Fixed2)
+						{
+							auto& raw(*reinterpret_cast<const sf::Vector2<Fixed>*>(object + position->offset));
+							value = sf::Vector2f(raw);
+						}
+						else
+						{
+							value = *reinterpret_cast<const sf::Vector2f*>(object + position->offset);
+						}
 
-			entity.AddGroup(SpaceInvadersGroup::PlayerShip);
+						minPosition.x = std::min(minPosition.x, value.x);
+						minPosition.y = std::min(minPosition.y, value.y);
+						maxPosition.x = std::max(maxPosition.x, value.x);
+						maxPosition.y = std::max(maxPosition.y, value.y);
+					}
+				}
 
-			return entity;
-		}
+				report << type.name << ": " << liveCount;
 
-		Entity& CreatePlayerBullet()
-		{
-			sf::Vector2f halfSize{ bulletWidth / 2.f, bulletHeight / 2.f };
-			auto& entity(manager.AddEntity());
+				if (groups != nullptr)
+				{
+					report << " [groups";
+					for (std::size_t g{0}; g < maxGroups; ++g)
+					{
+						if (groupCounts[g] > 0) report << " " << g << ":" << groupCounts[g];
+					}
+					report << "]";
+				}
 
-			entity.AddComponent<Transform>(sf::Vector2f{ windowWidth / 2.f, windowHeight / 2.f });
-			entity.AddComponent<Physics>(halfSize);
-			entity.AddComponent<RectangleRenderer>(this, halfSize, "data/laserBlue03.png");
+				if (position != nullptr && liveCount > 0)
+				{
+					report << " [bounds " << minPosition.x << "," << minPosition.y 
+						<< " - " << maxPosition.x << "," << maxPosition.y << "]";
+				}
 
-			auto& cPhysics(entity.GetComponent<Physics>());
-			cPhysics.velocity = sf::Vector2f{ 0, -bulletVelocity };
-			
-			// Disable Bullet
-			entity.Disable();
+				auto overflowCount(header.overflowCounts[t].load(std::memory_order_relaxed));
+				if (overflowCount > 0) report << " [" << overflowCount << " not shared: pool full]";
 
-			entity.AddGroup(SpaceInvadersGroup::PlayerBullet);
+				report << " | ";
+			}
 
-			return entity;
+			// If an update ran while we were reading, the report may be
+			// inconsistent: drop it and try again. The fence keeps the reads 
+			// above from being moved after the second load.
+			std::atomic_thread_fence(std::memory_order_acquire);
+			if (header.epoch.load(std::memory_order_relaxed) != epoch) continue;
+
+			std::cout << "epoch " << epoch / 2 << " | " << report.str() << "\n";
 		}
+	}
+}
 
-		void CreateAllPlayerBullets()
+namespace SpaceInvaders
+{
+	// `--replay <file> [tick]` prints what a recorded session looked like 
+	// at the given tick.
+	int InspectReplay(const std::string& filename, std::uint64_t tick)
+	{
+		ReplayReader reader;
+		if (!reader.Open(filename))
 		{
-			for (size_t i = 0; i < maxPlayerBullets; i++)
-			{
-				CreatePlayerBullet();
-			}
+			std::cerr << "Can't read the replay " << filename << "\n";
+			return 1;
 		}
 
-		Entity& CreateEnemyBullet()
+		std::cout << filename << ": " << reader.GetTickCount() << " ticks in " 
+			<< reader.GetChunkCount() << " chunks\n";
+
+		ReplayFrame frame;
+		if (!reader.Seek(tick, frame))
 		{
-			sf::Vector2f halfSize{ bulletWidth / 2.f, bulletHeight / 2.f };
-			auto& entity(manager.AddEntity());
+			std::cerr << "Tick " << tick << " is not in the replay\n";
+			return 1;
+		}
 
-			entity.AddComponent<Transform>(sf::Vector2f{ windowWidth / 2.f, windowHeight / 2.f });
-			entity.AddComponent<Physics>(halfSize);
-			entity.AddComponent<RectangleRenderer>(this, halfSize, "data/laserRed03.png");
+		std::array<std::size_t, maxGroups> groupCounts{};
+		for (std::uint32_t i{0}; i < frame.snapshot.entityCount; ++i)
+		{
+			auto& entity(frame.entities[i]);
+			if ((entity.flags & ReplayEntityState::Alive) == 0) continue;
 
-			auto& cPhysics(entity.GetComponent<Physics>());
-			cPhysics.velocity = sf::Vector2f{ 0, bulletVelocity };
+			for (std::size_t g{0}; g < maxGroups; ++g)
+				groupCounts[g] += (entity.groups >> g) & 1u;
+		}
 
-			// Disable Bullet
-			entity.Disable();
+		std::cout << "keyframe " << frame.snapshot.tick << " | score " << frame.snapshot.score 
+			<< " | entities " << frame.snapshot.entityCount << " [groups";
+		for (std::size_t g{0}; g < maxGroups; ++g)
+		{
+			if (groupCounts[g] > 0) std::cout << " " << g << ":" << groupCounts[g];
+		}
 
-			entity.AddGroup(SpaceInvadersGroup::EnemyBullet);
+		auto input(frame.inputs[frame.inputCount - 1]);
+		std::cout << "]\ntick " << tick << " | input"
+			<< ((input & ReplayLeft) ? " left" : "") 
+			<< ((input & ReplayRight) ? " right" : "") 
+			<< ((input & ReplayFire) ? " fire" : "") 
+			<< " | " << frame.inputCount << " ticks since the keyframe\n";
 
-			return entity;
-		}
+		return 0;
+	}
+}
 
-		void CreateAllEnemyBullets()
+namespace SpaceInvaders
+{
+	// `--bench` times the hot paths of the game on synthetic data, without
+	// a window. Every benchmark keeps the best of a few runs, the one the
+	// rest of the system disturbed the least. It fails, without timing 
+	// anything, if the batch math doesn't match the scalar math.
+	namespace Internal
+	{
+		// `setup` runs before every timed run, and isn't timed.
+		template<typename TSetup, typename TFunction> double TimeBestRun(int runs, 
+			TSetup&& setup, TFunction&& function)
 		{
-			for (size_t i = 0; i < maxEnemyBullets; i++)
+			auto best(std::numeric_limits<double>::max());
+
+			for (int i{0}; i < runs; ++i)
 			{
-				CreateEnemyBullet();
+				setup();
+
+				auto start(std::chrono::high_resolution_clock::now());
+				function();
+				auto end(std::chrono::high_resolution_clock::now());
+
+				best = std::min(best, std::chrono::duration<double, std::milli>(end - start).count());
 			}
+
+			return best;
 		}
 
-		Entity& CreateOffensiveEnemyShip(const sf::Vector2f& position)
+		template<typename TFunction> double TimeBestRun(int runs, TFunction&& function)
 		{
-			sf::Vector2f halfSize{ enemyShipWidth / 2.f, enemyShipHeight / 2.f };
-			auto& entity(manager.AddEntity());
-			
-			entity.AddComponent<Transform>(position);
-			entity.AddComponent<Physics>(halfSize);
-			entity.AddComponent<RectangleRenderer>(this, halfSize, "data/enemyRed2.png");
-			entity.AddComponent<WeaponAIController>(&manager, currentEnemyBullet);
+			return TimeBestRun(runs, [] { }, function);
+		}
+	}
 
-			auto& cPhysics(entity.GetComponent<Physics>());
-			cPhysics.velocity = sf::Vector2f{ enemyShipVelocity, 0 };
+	// A full particle buffer, updated once per frame. Particles live long
+	// enough not to die during the runs, so only integration and the 
+	// compaction scan are timed.
+	void BenchmarkParticles(std::ostream& out)
+	{
+		RandomService random{ randomSeed };
+		ParticleSystem particles{ random };
+		particles.EmitBurst(sf::Vector2f{ 0.f, 0.f }, static_cast<int>(maxParticles), 
+			explosionSpeed, 1e9f, sf::Color::White);
 
-			entity.AddGroup(SpaceInvadersGroup::OffensiveEnemyShip);
+		auto time(Internal::TimeBestRun(20, [&] { particles.Update(1.f); }));
 
-			return entity;
-		}
+		out << "particles: " << particles.GetCount() << " updated in " << time << " ms (target 2 ms)\n";
+	}
+
+	// A million render queue keys, laid out like `RenderQueue::Push` 
+	// builds them, from a few layers and textures. `std::sort` gives the
+	// comparison.
+	void BenchmarkRenderQueueSort(std::ostream& out)
+	{
+		const std::size_t keyCount{ 1u << 20 };
+		auto stream(RandomService{ randomSeed }.GetStream(RandomStreamID::Particles));
 
-		Entity& CreateDefensiveEnemyShip(const sf::Vector2f& position)
+		std::vector<std::uint64_t> input(keyCount), keys, scratch;
+		for (std::size_t i{0}; i < keyCount; ++i)
 		{
-			sf::Vector2f halfSize{ enemyShipWidth / 2.f, enemyShipHeight / 2.f };
-			auto& entity(manager.AddEntity());
+			input[i] = (static_cast<std::uint64_t>(stream.NextInt(0, 3)) << 56)
+				| (static_cast<std::uint64_t>(stream.NextInt(0, 15)) << 40)
+				| (static_cast<std::uint64_t>(stream.NextInt(0, 0xFFFF)) << 24)
+				| i;
+		}
 
-			entity.AddComponent<Transform>(position);
-			entity.AddComponent<Physics>(halfSize);
-			entity.AddComponent<RectangleRenderer>(this, halfSize, "data/enemyGreen3.png");
+		auto reset([&] { keys = input; });
+		auto radixTime(Internal::TimeBestRun(10, reset, [&] { Internal::RadixSort(keys, scratch); }));
+		auto sorted(std::is_sorted(keys.begin(), keys.end()));
+		auto stdTime(Internal::TimeBestRun(10, reset, [&] { std::sort(keys.begin(), keys.end()); }));
 
-			auto& cPhysics(entity.GetComponent<Physics>());
-			cPhysics.velocity = sf::Vector2f{ enemyShipVelocity, 0 };
+		out << "render queue: " << keyCount << " keys radix sorted in " << radixTime << " ms (" 
+			<< keyCount / radixTime / 1000.0 << " M keys/s), std::sort " << stdTime << " ms"
+			<< (sorted ? "" : " [NOT SORTED]") << "\n";
+	}
 
-			entity.AddGroup(SpaceInvadersGroup::DefensiveEnemyShip);
+	// What `MovementKernel` and the bounds checks do to every moving 
+	// entity, on a million of them, with `T` as the scalar type.
+	template<typename T> double TimeMovement(std::size_t count, std::size_t& outOfBounds)
+	{
+		using Vector = sf::Vector2<T>;
 
-			return entity;
-		}
+		std::vector<Vector> positions(count, Vector{ T(windowWidth / 2), T(windowHeight / 2) });
+		std::vector<Vector> velocities(count, Vector{ T(enemyShipVelocity), T(-bulletVelocity) });
+		Vector halfSize{ T(bulletWidth / 2.f), T(bulletHeight / 2.f) };
 
-		void CreateEnemyShips()
+		return Internal::TimeBestRun(10, [&]
 		{
-			for (int iX{ 0 }; iX < countEnemyColumn; ++iX)
+			for (std::size_t i{0}; i < count; ++i)
 			{
-				for (int iY{ 0 }; iY < countEnemyRow; ++iY)
-				{
-					if (iY % 2 == 0)
-					{
-						CreateOffensiveEnemyShip(sf::Vector2f{
-							(iX + 1) * (enemyShipWidth + 5) + 22,
-							(iY + 1) * (enemyShipHeight + 5) });
-					}
-					else
-					{
-						CreateDefensiveEnemyShip(sf::Vector2f{
-							(iX + 1) * (enemyShipWidth + 5) + 22,
-							(iY + 1) * (enemyShipHeight + 5) });
-					}
-				}
-			}
-		}
-
-		Game()
-		{
-			window.setFramerateLimit(240);
+				positions[i] += velocities[i] * T(ftStep);
 
-			CreatePlayerShip();
-			CreateEnemyShips();
-			CreateAllPlayerBullets();
-			CreateAllEnemyBullets();
-		}
+				if (positions[i].x - halfSize.x < T(0) || positions[i].x + halfSize.x > T(windowWidth) ||
+					positions[i].y + halfSize.y < T(0)) ++outOfBounds;
+			}
+		});
+	}
 
-		void Run()
-		{
-			running = true;
+	void BenchmarkFixedPoint(std::ostream& out)
+	{
+		const std::size_t count{ 1u << 20 };
+		std::size_t outOfBounds{0};
 
-			while(running)
-			{
-				auto timePoint1(std::chrono::high_resolution_clock::now());
-				
-				window.clear(sf::Color::Black);
+		auto floatTime(TimeMovement<float>(count, outOfBounds));
+		auto fixedTime(TimeMovement<Fixed>(count, outOfBounds));
 
-				InputPhase(lastFt);
-				UpdatePhase();
-				DrawPhase();		
+		out << "movement: " << count << " entities in " << fixedTime << " ms with Fixed, " 
+			<< floatTime << " ms with float (" << fixedTime / floatTime << "x, " 
+			<< outOfBounds << " out of bounds)\n";
+	}
 
-				auto timePoint2(std::chrono::high_resolution_clock::now());
-				auto elapsedTime(timePoint2 - timePoint1);
-				FrameTime ft{ std::chrono::duration_cast<
-					std::chrono::duration<float, std::milli >> (elapsedTime).count() };
-				
-				lastFt = ft;	
-			}	
-		}
+	// The batched structural operations on 100k entities, next to the
+	// same changes made one entity at a time. Whatever a run changes is
+	// undone before the next one, outside of the timing.
+	void BenchmarkBatchedOperations(std::ostream& out)
+	{
+		const std::size_t count{ 100000 };
+		const int runs{ 10 };
 
-		void InputPhase(FrameTime frameTime)
+		EntityManager manager;
+		std::vector<Entity*> entities;
+		for (std::size_t i{0}; i < count; ++i)
 		{
-			sf::Event event;
-			while(window.pollEvent(event)) 
-			{ 
-				if (event.type == sf::Event::Closed)
-				{
-					window.close();
-					break;
-				}
-			}
-
-			if (sf::Keyboard::isKeyPressed(sf::Keyboard::Key::Escape)) 
-				running = false;
+			auto& entity(manager.AddEntity());
+			entity.AddComponent<Transform>();
+			entities.emplace_back(&entity);
 		}
+		manager.Refresh();
 
-		void UpdatePhase()
+		auto report([&](const char* operation, double batchTime, double singleTime)
 		{
-			currentSlice += lastFt;
-			for(; currentSlice >= ftSlice; currentSlice -= ftSlice)
-			{	
-				manager.Refresh();
-				manager.Update(ftStep);
+			out << "batched " << operation << ": " << count << " entities in " << batchTime 
+				<< " ms (target 1 ms), " << singleTime << " ms one at a time\n";
+		});
+
+		auto leaveGroup([&] { manager.DelGroup(entities, DefensiveEnemyShip); manager.Refresh(); });
+		report("AddGroup",
+			Internal::TimeBestRun(runs, leaveGroup, [&] { manager.AddGroup(entities, DefensiveEnemyShip); }),
+			Internal::TimeBestRun(runs, leaveGroup, [&] { for (auto e : entities) e->AddGroup(DefensiveEnemyShip); }));
+
+		auto enable([&] { manager.Enable(entities); });
+		report("Disable",
+			Internal::TimeBestRun(runs, enable, [&] { manager.Disable(entities); }),
+			Internal::TimeBestRun(runs, enable, [&] { for (auto e : entities) e->Disable(); }));
+		enable();
+
+		auto removePhysics([&] 
+		{ 
+			if (entities.front()->HasComponent<Physics>()) manager.RemoveComponent<Physics>(entities); 
+		});
+		Vec2 halfSize{ Scalar(bulletWidth / 2.f), Scalar(bulletHeight / 2.f) };
+		report("AddComponent",
+			Internal::TimeBestRun(runs, removePhysics, [&] { manager.AddComponent<Physics>(entities, halfSize); }),
+			Internal::TimeBestRun(runs, removePhysics, [&] { for (auto e : entities) e->AddComponent<Physics>(halfSize); }));
+	}
 
-				float leftEnemyShipBorder = 0.f;
-				float rightEnemyShipBorder = windowWidth;
-				bool needToChangeEnemyShipDirection = false;
+	// Entities built through a `ConcurrentSpawner` on 1, 2, 4... threads,
+	// up to the number of hardware threads, and published to a world.
+	void BenchmarkConcurrentSpawning(std::ostream& out)
+	{
+		const std::size_t count{ 100000 }, grainSize{ 1024 };
+		Vec2 halfSize{ Scalar(bulletWidth / 2.f), Scalar(bulletHeight / 2.f) };
 
-				// We get our entities by group...
-				auto& playerShip(manager.GetEntitiesByGroup(PlayerShip));
-				auto& playerBullets(manager.GetEntitiesByGroup(PlayerBullet));
-				auto& offensiveEnemyShips(manager.GetEntitiesByGroup(OffensiveEnemyShip));
-				auto& defensiveEnemyShips(manager.GetEntitiesByGroup(DefensiveEnemyShip));
-				auto& enemyBullets(manager.GetEntitiesByGroup(EnemyBullet));
+		ResourceRegistry resources;
+		std::unique_ptr<EntityManager> world;
+		auto hardwareThreads(static_cast<std::size_t>(std::max(1u, std::thread::hardware_concurrency())));
+		double singleThreadTime{0.0};
 
-				// ...and perform collision tests on them.
-				for (auto& pB : playerBullets)
-				{
-					for (auto& deS : defensiveEnemyShips)
-					{
-						TestCollisionPlayerBulletWithEnemyShip(*pB, *deS);
-						
-						auto& cPhysics = deS->GetComponent<Physics>();
-						float left = cPhysics.left();
-						float right = cPhysics.right();
-						if (left < leftEnemyShipBorder || right > rightEnemyShipBorder)
-						{
-							needToChangeEnemyShipDirection = true;
-						}
-					}
+		for (std::size_t threadCount{1}; ; threadCount = std::min(threadCount * 2, hardwareThreads))
+		{
+			WorkerPool workers{ threadCount - 1 };
+			ConcurrentSpawner spawner{ resources };
 
-					for (auto& oeS : offensiveEnemyShips)
+			auto time(Internal::TimeBestRun(5, 
+				[&] 
+				{
+					world = std::make_unique<EntityManager>();
+					world->SetResources(resources);
+				},
+				[&]
+				{
+					spawner.Spawn(workers, count, grainSize, [&](EntityManager& target, std::size_t)
 					{
-						TestCollisionPlayerBulletWithEnemyShip(*pB, *oeS);
-						
-						auto& cPhysics = oeS->GetComponent<Physics>();
-						float left = cPhysics.left();
-						float right = cPhysics.right();
-						if (left < leftEnemyShipBorder || right > rightEnemyShipBorder)
-						{
-							needToChangeEnemyShipDirection = true;
-						}
-					}
+						auto& entity(target.AddEntity());
+						entity.AddComponent<Transform>();
+						entity.AddComponent<Physics>(halfSize);
+					});
+					spawner.Publish(*world);
+				}));
 
-					// Check player Bullets if they go out of bounds
-					auto& cPhysics = pB->GetComponent<Physics>();
+			if (threadCount == 1) singleThreadTime = time;
 
-					if (cPhysics.bottom() < 0.f)
-					{
-						pB->Disable();
-					}
-				}
+			out << "spawn: " << world->GetEntityCount() << " entities on " << threadCount << " threads in " 
+				<< time << " ms (" << singleThreadTime / time << "x)\n";
 
-				for (auto& eB : enemyBullets)
-				{
-					for (auto& pS : playerShip)
-						TestCollisionEnemyBulletWithPlayerShip(*eB, *pS);
+			if (threadCount == hardwareThreads) break;
+		}
+	}
 
-					// Check enemy Bullets if they go out of bounds
-					auto& cPhysics = eB->GetComponent<Physics>();
+	// Several producers push timestamped items to one `MpscQueue`, as fast
+	// as they can, while this thread drains it in batches like the 
+	// simulation does. Latency is from the push to the pop.
+	void BenchmarkMpscQueue(std::ostream& out)
+	{
+		using Clock = std::chrono::high_resolution_clock;
+		const std::size_t itemCount{ 1u << 20 }, batchSize{ 64 };
 
-					if (cPhysics.bottom() > windowHeight)
+		for (std::size_t producerCount : { 1u, 2u, 4u, 8u })
+		{
+			MpscQueue<Clock::time_point, inputQueueCapacity> queue;
+			std::vector<Clock::time_point> batch;
+			std::vector<float> latencies;
+			latencies.reserve(itemCount);
+
+			auto start(Clock::now());
+			std::vector<std::thread> producers;
+			for (std::size_t p{0}; p < producerCount; ++p)
+			{
+				producers.emplace_back([&queue, itemCount, producerCount]
+				{
+					for (std::size_t i{0}; i < itemCount / producerCount; ++i)
 					{
-						eB->Disable();
+						while (!queue.TryPush(Clock::now())) std::this_thread::yield();
 					}
-				}
+				});
+			}
 
-				if (needToChangeEnemyShipDirection)
+			auto expected(itemCount / producerCount * producerCount);
+			while (latencies.size() < expected)
+			{
+				batch.clear();
+				if (queue.PopBatch(std::back_inserter(batch), batchSize) == 0)
 				{
-					ChangeEnemiesShipDirection();
+					std::this_thread::yield();
+					continue;
 				}
+
+				auto now(Clock::now());
+				for (auto& pushed : batch)
+					latencies.emplace_back(std::chrono::duration<float, std::micro>(now - pushed).count());
 			}
-		}
 
-		void ChangeEnemiesShipDirection()
-		{
-			auto& offensiveEnemyShips(manager.GetEntitiesByGroup(OffensiveEnemyShip));
-			auto& defensiveEnemyShips(manager.GetEntitiesByGroup(DefensiveEnemyShip));
+			auto time(std::chrono::duration<double, std::milli>(Clock::now() - start).count());
+			for (auto& producer : producers) producer.join();
 
-			for (auto& deS : defensiveEnemyShips)
+			auto percentile([&](double p)
 			{
-				auto& cPhysics = deS->GetComponent<Physics>();
-
-				cPhysics.velocity.x = -cPhysics.velocity.x;
+				auto nth(std::begin(latencies) + static_cast<std::ptrdiff_t>(p * (latencies.size() - 1)));
+				std::nth_element(std::begin(latencies), nth, std::end(latencies));
+				return *nth;
+			});
+			auto median(percentile(0.5)), tail(percentile(0.99));
+
+			out << "mpsc queue: " << producerCount << " producers, " << latencies.size() / time / 1000.0 
+				<< " M items/s, latency median " << median << " us, 99% " << tail << " us\n";
+		}
+	}
 
-				// Move down
-				cPhysics.SetY(cPhysics.y() + 5.f);
-			}
+	// Before timing anything, the batch math is compared lane by lane, 
+	// bit for bit, with the scalar expressions it stands for, on random 
+	// values and on the ones that tell instruction sets apart: signed 
+	// zeros and equal operands. Returns the number of mismatches.
+	std::size_t CheckBatchMath(std::ostream& out)
+	{
+		auto stream(RandomService{ randomSeed }.GetStream(RandomStreamID::Particles));
+		const float specials[]{ 0.f, -0.f, 1.f, -1.f, 0.5f };
+		std::size_t lanesChecked{0}, mismatches{0};
 
-			for (auto& oeS : offensiveEnemyShips)
-			{
-				auto& cPhysics = oeS->GetComponent<Physics>();
+		auto check([&](bool same, const char* operation, float a, float b)
+		{
+			++lanesChecked;
+			if (!same && ++mismatches <= 10) 
+				out << "batch math: " << operation << " differs from scalar for " << a << ", " << b << "\n";
+		});
 
-				cPhysics.velocity.x = -cPhysics.velocity.x;
+		auto same([](float a, float b) { return std::memcmp(&a, &b, sizeof(float)) == 0; });
 
-				// Move down
-				cPhysics.SetY(cPhysics.y() + 5.f);
+		for (int round{0}; round < 4096; ++round)
+		{
+			float a[8], b[8], c[8];
+			for (std::size_t i{0}; i < 8; ++i)
+			{
+				auto pick(stream.NextInt(0, 3));
+				a[i] = pick == 0 ? specials[stream.NextInt(0, 4)] : stream.NextFloat(-100.f, 100.f);
+				b[i] = pick == 0 ? specials[stream.NextInt(0, 4)] : pick == 1 ? a[i] : pick == 2 ? -a[i] 
+					: stream.NextFloat(-100.f, 100.f);
+				c[i] = stream.NextFloat(-100.f, 100.f);
 			}
-		}
-
-		void DrawPhase() 
-		{ 
-			manager.Draw(); 
-			window.display(); 
-		}
 
-		void Render(const sf::Drawable& mDrawable) 
-		{ 
-			window.draw(mDrawable); 
+			auto va(Floatx8::Load(a)), vb(Floatx8::Load(b)), vc(Floatx8::Load(c));
+			float sum[8], difference[8], product[8], mulAdd[8], minimum[8], maximum[8];
+			(va + vb).Store(sum);
+			(va - vb).Store(difference);
+			(va * vb).Store(product);
+			MulAdd(va, vb, vc).Store(mulAdd);
+			Min(va, vb).Store(minimum);
+			Max(va, vb).Store(maximum);
+
+			auto less((va < vb).ToBits()), lessEqual((va <= vb).ToBits());
+			auto greater((va > vb).ToBits()), greaterEqual((va >= vb).ToBits());
+			auto both(((va < vb) & (vb < vc)).ToBits()), either(((va < vb) | (vb < vc)).ToBits());
+
+			// The lanes that aren't stored must keep what they had.
+			float maskedX[8], maskedY[8];
+			std::copy(std::begin(c), std::end(c), std::begin(maskedX));
+			std::copy(std::begin(a), std::end(a), std::begin(maskedY));
+			MulAdd(Vec2x8{ va, vb }, vc, Vec2x8{ vb, va }).StoreMasked(maskedX, maskedY, va < vb);
+
+			for (std::size_t i{0}; i < 8; ++i)
+			{
+				auto bit([&](unsigned bits) { return (bits >> i & 1u) != 0; });
+
+				check(same(sum[i], a[i] + b[i]), "+", a[i], b[i]);
+				check(same(difference[i], a[i] - b[i]), "-", a[i], b[i]);
+				check(same(product[i], a[i] * b[i]), "*", a[i], b[i]);
+				check(same(mulAdd[i], a[i] * b[i] + c[i]), "MulAdd", a[i], b[i]);
+				check(same(minimum[i], std::min(a[i], b[i])), "Min", a[i], b[i]);
+				check(same(maximum[i], std::max(a[i], b[i])), "Max", a[i], b[i]);
+				check(bit(less) == (a[i] < b[i]), "<", a[i], b[i]);
+				check(bit(lessEqual) == (a[i] <= b[i]), "<=", a[i], b[i]);
+				check(bit(greater) == (a[i] > b[i]), ">", a[i], b[i]);
+				check(bit(greaterEqual) == (a[i] >= b[i]), ">=", a[i], b[i]);
+				check(bit(both) == (a[i] < b[i] && b[i] < c[i]), "&", a[i], b[i]);
+				check(bit(either) == (a[i] < b[i] || b[i] < c[i]), "|", a[i], b[i]);
+				check(same(maskedX[i], a[i] < b[i] ? a[i] * c[i] + b[i] : c[i]), "StoreMasked", a[i], b[i]);
+				check(same(maskedY[i], a[i] < b[i] ? b[i] * c[i] + a[i] : a[i]), "StoreMasked", a[i], b[i]);
+			}
 		}
-	};
 
-	void RectangleRenderer::Draw()
-	{
-		game->Render(shape);
+		out << "batch math (" << Internal::Simd::name << "): " << lanesChecked << " lanes checked, " 
+			<< mismatches << " mismatches\n";
+		return mismatches;
 	}
 
-	void PlayerController::UsePlayerShipWeapon(const sf::Vector2f& bulletSpawnLocation, int& currentPlayerBullet)
+	int RunBenchmarks()
 	{
-		if (currentPlayerBullet == maxPlayerBullets)
-		{
-			currentPlayerBullet = 0;
-		}
+		std::cout << std::fixed << std::setprecision(3);
 
-		auto playerBulletList = manager->GetEntitiesByGroup(SpaceInvadersGroup::PlayerBullet);
+		if (CheckBatchMath(std::cout) != 0) return 1;
 
-		auto& cPlayerBulletTransform(playerBulletList[currentPlayerBullet]->GetComponent<Transform>());
+		BenchmarkParticles(std::cout);
+		BenchmarkRenderQueueSort(std::cout);
+		BenchmarkFixedPoint(std::cout);
+		BenchmarkBatchedOperations(std::cout);
+		BenchmarkConcurrentSpawning(std::cout);
+		BenchmarkMpscQueue(std::cout);
 
-		cPlayerBulletTransform.position.x = bulletSpawnLocation.x;
-		cPlayerBulletTransform.position.y = bulletSpawnLocation.y - 45;
+		return 0;
+	}
+}
 
-		playerBulletList[currentPlayerBullet]->Enable();
+// Program entry point
+int main(int argc, char* argv[]) 
+{	
+	std::string mode{ argc > 1 ? argv[1] : "" };
 
-		currentPlayerBullet++;
+	if (mode == "--stats")
+	{
+		SpaceInvaders::Internal::OpenConsole();
+		return SpaceInvaders::TailStats();
 	}
 
-	void WeaponAIController::UseEnemyShipWeapon(const sf::Vector2f& bulletSpawnLocation, int& currentEnemyBullet)	
+	if (mode == "--inspect")
 	{
-		if (currentEnemyBullet == maxEnemyBullets)
-		{
-			currentEnemyBullet = 0;
-		}
+		SpaceInvaders::Internal::OpenConsole();
+		return SpaceInvaders::InspectWorld();
+	}
 
-		auto& enemyBulletList = manager->GetEntitiesByGroup(SpaceInvadersGroup::EnemyBullet);
+	if (mode == "--bench")
+	{
+		SpaceInvaders::Internal::OpenConsole();
+		return SpaceInvaders::RunBenchmarks();
+	}
 
-		auto& cEnemyBulletTransform(enemyBulletList[currentEnemyBullet]->GetComponent<Transform>());
+	if (mode == "--replay")
+	{
+		SpaceInvaders::Internal::OpenConsole();
 
-		cEnemyBulletTransform.position.x = bulletSpawnLocation.x;
-		cEnemyBulletTransform.position.y = bulletSpawnLocation.y + 45;
+		// The tick is optional, but it must be a plain number.
+		char* end{nullptr};
+		auto tick(argc > 3 ? std::strtoull(argv[3], &end, 10) : 0);
 
-		enemyBulletList[currentEnemyBullet]->Enable();
+		if (argc < 3 || (argc > 3 && (end == argv[3] || *end != '\0' || argv[3][0] == '-')))
+		{
+			std::cerr << "Usage: " << argv[0] << " --replay <file> [tick]\n";
+			return 1;
+		}
 
-		currentEnemyBullet++;
+		return SpaceInvaders::InspectReplay(argv[2], tick);
 	}
-}
 
-// Program entry point
-int main() 
-{	
+	if (mode == "--shared-world" && !SpaceInvaders::WorldInspector::Start())
+		std::cerr << "Can't create the shared world segment\n";
+
 	SpaceInvaders::Game{}.Run();
 
 	return 0;